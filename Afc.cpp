@@ -0,0 +1,154 @@
+/*
+ *  Afc.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "Afc.h"
+#include "MRF49XA.h"
+#include "MRF49XA_definitions.h"
+#include "PacketTypes.h"
+#include "Registers.h"
+
+Afc_t Afc = Afc_t();
+
+#define AFC_LIMIT ((int16_t)AFC_CORRECTION_MAX << AFC_FRACTION_BITS)
+
+void Afc_t::Begin(uint8_t mode, uint8_t range, uint16_t freqb)
+{
+	uint16_t afccreg = MRF_AFCCREG | (mode & MRF_AUTOMS_INDP) | (range & MRF_ARFO_3to4);
+
+	// Measure the offset, and add it to the synthesizer while receiving
+	if (mode != MRF_AUTOMS_OFF) afccreg |= MRF_HAM | MRF_FOREN | MRF_FOFEN;
+
+	Registers.ApplyRegisterValue(MRF_REG_AFCREG, afccreg);
+
+	count = 0;
+	this->freqb = freqb;
+	Apply(0);
+}
+
+MRF_afc_peer_t *Afc_t::Find(uint8_t peer)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (peers[i].peer == peer) return &peers[i];
+	}
+
+	return NULL;
+}
+
+void Afc_t::Track(uint8_t peer, MRF_frame_info_t info)
+{
+	MRF_afc_peer_t *entry = Find(peer);
+
+	if (entry == NULL)
+	{
+		if (count < AFC_PEERS)
+		{
+			entry = &peers[count++];
+		}
+		else
+		{
+			entry = &peers[0];
+			for (uint8_t i = 1; i < count; i++)
+			{
+				if (peers[i].frames < entry->frames) entry = &peers[i];
+			}
+		}
+
+		entry->peer = peer;
+		entry->frames = 0;
+	}
+
+	// The offset was measured against wherever we were tuned
+	int16_t target = (int16_t)(tuned + MRF_AFC_OFFSET(info.status)) << AFC_FRACTION_BITS;
+
+	if (entry->frames == 0) entry->correction = target;
+	else entry->correction += (target - entry->correction) >> AFC_GAIN_SHIFT;
+
+	if (entry->correction >  AFC_LIMIT) entry->correction =  AFC_LIMIT;
+	if (entry->correction < -AFC_LIMIT) entry->correction = -AFC_LIMIT;
+
+	if (entry->frames < 255) entry->frames++;
+}
+
+uint8_t Afc_t::PacketReceived(MRF_packet_t *packet)
+{
+	// A forwarded frame was last sent by the repeater, not by its source
+	if (!(packet->type & PACKET_FLAG_RELAY)) return 0;
+	if (RELAY_HOPS(packet->hops) != 0) return 0;
+
+	Track(packet->source, MRF49XA.GetFrameInfo());
+
+	return 1;
+}
+
+void Afc_t::Apply(int8_t correction)
+{
+	uint16_t channel = (freqb + correction) & MRF_FREQB_MASK;
+
+	tuned = correction;
+
+	// Outside the synthesizer's range, as MRF49XA.SetFrequency() does
+	if (channel < MRF_FREQB_MIN || channel > MRF_FREQB_MAX) return;
+
+	Registers.ApplyRegisterValue(MRF_REG_CFSREG, MRF_CFSREG | channel);
+}
+
+void Afc_t::Tune(uint8_t peer)
+{
+	Apply(GetCorrection(peer));
+}
+
+void Afc_t::Untune(void)
+{
+	Apply(0);
+}
+
+int8_t Afc_t::GetCorrection(uint8_t peer)
+{
+	MRF_afc_peer_t *entry = Find(peer);
+
+	if (entry == NULL) return 0;
+
+	// Round to the nearest step
+	return (entry->correction + (1 << (AFC_FRACTION_BITS - 1))) >> AFC_FRACTION_BITS;
+}
+
+uint8_t Afc_t::GetPeer(uint8_t index, MRF_afc_peer_t *entry)
+{
+	if (index >= count) return 0;
+
+	*entry = peers[index];
+
+	return 1;
+}
+
+void Afc_t::Forget(void)
+{
+	count = 0;
+	Apply(0);
+}
+
+const char afcHeaderString[] PROGMEM = "\n\rPeer Frames Correction";
+
+void Afc_t::Report(Print &out)
+{
+	MRF_afc_peer_t entry;
+
+	out.print(afcHeaderString);
+
+	for (uint8_t i = 0; GetPeer(i, &entry); i++)
+	{
+		out.print("\n\r");
+		out.print(entry.peer, DEC);
+		out.print(' ');
+		out.print(entry.frames, DEC);
+		out.print(' ');
+		out.print(GetCorrection(entry.peer), DEC);
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ *  Afc.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef AFC_H
+#define AFC_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Number of peers a correction is kept for.  Each entry takes 4 bytes of
+// SRAM; when the table is full the peer with the fewest frames is replaced.
+#define AFC_PEERS            8
+
+// Each frame moves the correction 1/2^AFC_GAIN_SHIFT of the way to the
+// offset it measured.  The first frame from a peer sets it outright.
+#define AFC_GAIN_SHIFT       2
+
+// Largest correction, in Fres steps (2.5 kHz in the 434 MHz band).  Beyond
+// this the crystals are out of spec, or the frame came from a neighbouring
+// channel.
+#define AFC_CORRECTION_MAX   40
+
+// Corrections are kept in 1/16 Fres so the average can settle between steps
+#define AFC_FRACTION_BITS    4
+
+// Signed AFC offset, in Fres steps, from a STSREG reading.  OFFSV is the
+// sign of the 5 bit two's complement value.
+#define MRF_AFC_OFFSET(status) ((int8_t)((uint8_t)((status) & (MRF_OFFSV | MRF_OFFSET_MASK)) << 3) >> 3)
+
+typedef struct {
+	uint8_t peer;
+	uint8_t frames;			// Frames measured, saturates at 255
+	int16_t correction;		// Fres / 16, added to FREQB for this peer
+} MRF_afc_peer_t;
+
+// Frequency tracking.  The hardware AFC measures the offset of every
+// incoming signal; the driver records STSREG at the start of each frame,
+// and this keeps a running average of the offset for each peer.  Tune()
+// moves the synthesizer onto a peer before talking to it, so both what
+// is sent and the reply land in the middle of the receive filter.  That
+// makes a narrower MRF_RXBW_* and a higher data rate usable with crystals
+// that are several Fres apart.
+//
+// Only one side of a link needs to tune.  If both do, each measures the
+// other relative to where it is tuned, and the two corrections settle on
+// splitting the difference.
+class Afc_t
+{
+public:
+	// mode is one of MRF_AUTOMS_* and range one of MRF_ARFO_*.  The
+	// tracker needs an offset to read, so RECV or INDP; with OFF the
+	// hardware AFC is disabled and the corrections stay where they are.
+	// freqb is the channel, as given to MRF49XA.SetFrequency().  Both
+	// registers are written through Registers.ApplyRegisterValue(), so a
+	// profile switch sees them, but they aren't saved: call this after
+	// the registers were applied and again after switching profiles.
+	void Begin(uint8_t mode, uint8_t range, uint16_t freqb);
+
+	// Records the offset of a frame from peer.  Call right after the
+	// frame was taken, before the next ReceivePacket().
+	void Track(uint8_t peer, MRF_frame_info_t info);
+
+	// Hand every received packet to this.  Relayed frames that have not
+	// been forwarded yet name their sender, and are tracked.  Returns 1
+	// if the packet was used.
+	uint8_t PacketReceived(MRF_packet_t *packet);
+
+	// Retunes to the peer, or back to the channel.  This moves the
+	// synthesizer, so call it while the link is idle.
+	void Tune(uint8_t peer);
+	void Untune(void);
+
+	int8_t GetCorrection(uint8_t peer);	// Fres steps, 0 if unknown
+	uint8_t GetPeer(uint8_t index, MRF_afc_peer_t *entry);
+	void Forget(void);
+	void Report(Print &out);
+private:
+	MRF_afc_peer_t *Find(uint8_t peer);
+	void Apply(int8_t correction);
+
+	MRF_afc_peer_t peers[AFC_PEERS];
+	uint8_t count;
+	uint16_t freqb;
+	int8_t tuned;			// Correction currently applied, Fres steps
+};
+
+extern Afc_t Afc;
+
+#endif // AFC_H
@@ -0,0 +1,101 @@
+/*
+ *  Aggregate.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "Aggregate.h"
+#include "MRF49XA.h"
+
+Aggregate_t Aggregate = Aggregate_t();
+
+void Aggregate_t::Begin(uint8_t type, uint8_t address, uint16_t latency)
+{
+	Flush();
+
+	this->type    = type;
+	this->address = address;
+	this->latency = latency;
+}
+
+uint8_t Aggregate_t::Add(const uint8_t *message, uint8_t length)
+{
+	if (length == 0 || length > MRF_PAYLOAD_LEN - BATCH_HEADER_LEN) return 0;
+
+	// Send the partial frame if this message doesn't fit
+	if (count && Pool.Get(handle)->payloadSize + BATCH_HEADER_LEN + length > MRF_PAYLOAD_LEN) Flush();
+
+	if (count == 0) 
+	{
+		handle = Pool.Allocate(MRF_OWNER_APP, 0);
+		if (handle == MRF_HANDLE_NONE) return 0;
+
+		MRF_packet_t *packet = Pool.Get(handle);
+
+		packet->payloadSize = 0;
+		packet->type    = type;
+		packet->address = address;
+		packet->hops    = 0;
+
+		started = millis();
+	}
+
+	MRF_packet_t *packet = Pool.Get(handle);
+	uint8_t *end = &packet->payload[packet->payloadSize];
+
+	*end++ = length;
+	memcpy(end, message, length);
+
+	packet->payloadSize += BATCH_HEADER_LEN + length;
+	count++;
+
+	// A full frame needn't wait
+	if (packet->payloadSize == MRF_PAYLOAD_LEN) Flush();
+
+	return 1;
+}
+
+void Aggregate_t::Flush(void)
+{
+	if (count == 0) return;
+
+	count = 0;
+	MRF49XA.TransmitHandle(handle);
+}
+
+void Aggregate_t::Service(void)
+{
+	if (count && (uint32_t)(millis() - started) >= latency) Flush();
+}
+
+uint8_t Aggregate_t::Pending(void)
+{
+	return count;
+}
+
+// Malformed lists are cut off at the last complete message
+uint8_t Aggregate_t::Unpack(const MRF_packet_t *packet, MRF_message_handler_t handler)
+{
+	uint8_t kind = packet->type & PACKET_TYPE_MASK;
+	uint8_t messages = 0;
+	uint8_t offset = 0;
+
+	if (kind != PACKET_TYPE_BATCH && kind != PACKET_TYPE_BATCH_ECC) return 0;
+
+	while (offset < packet->payloadSize) 
+	{
+		uint8_t length = packet->payload[offset];
+
+		if (length == 0 || length > packet->payloadSize - offset - BATCH_HEADER_LEN) break;
+
+		handler(&packet->payload[offset + BATCH_HEADER_LEN], length);
+
+		offset += BATCH_HEADER_LEN + length;
+		messages++;
+	}
+
+	return messages;
+}
@@ -0,0 +1,56 @@
+/*
+ *  Aggregate.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Called by Unpack() once for every message in a batch frame
+typedef void (*MRF_message_handler_t)(const uint8_t *message, uint8_t length);
+
+// Packs small messages into batch frames (PACKET_TYPE_BATCH), so the
+// preamble, sync word, header and turnaround are paid once per frame
+// instead of once per message.  Each message costs one length byte.  A
+// frame is sent when the next message doesn't fit, or when its first
+// message has waited for the latency bound.
+//
+// The frame is built in place in a pool buffer and handed to the
+// transmitter as it is.
+class Aggregate_t
+{
+public:
+	// type is PACKET_TYPE_BATCH or PACKET_TYPE_BATCH_ECC, with any flags.
+	// address is used for PACKET_FLAG_ADDRESSED frames.  latency is the
+	// longest a message waits before its frame is sent, in milliseconds.
+	void Begin(uint8_t type, uint8_t address, uint16_t latency);
+
+	// Queues one message.  Returns 0 if it can't be sent: it's empty or
+	// longer than a frame, or there's no free buffer in the pool.
+	uint8_t Add(const uint8_t *message, uint8_t length);
+
+	void Flush(void);		// Sends the partial frame now
+	void Service(void);		// Call from loop(), enforces the latency bound
+	uint8_t Pending(void);	// Messages waiting in the partial frame
+
+	// Splits a received batch frame into its messages.  Returns the number
+	// of messages, 0 if the packet isn't a batch frame.
+	uint8_t Unpack(const MRF_packet_t *packet, MRF_message_handler_t handler);
+private:
+	MRF_handle_t handle;
+	uint8_t type;
+	uint8_t address;
+	uint8_t count;
+	uint16_t latency;
+	uint32_t started;		// millis() when the first message was added
+};
+
+extern Aggregate_t Aggregate;
+
+#endif
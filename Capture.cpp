@@ -0,0 +1,151 @@
+/*
+ *  Capture.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "Capture.h"
+#include "MRF49XA.h"
+#include "Crc.h"
+
+Capture_t Capture = Capture_t();
+
+#define CAPTURE_MASK (CAPTURE_BUFFER_LEN - 1)
+
+void Capture_t::Begin(Print &output)
+{
+	this->output = &output;
+	head = tail = 0;
+	dropped = droppedTotal = 0;
+}
+
+uint8_t Capture_t::Record(MRF_packet_t *packet)
+{
+	MRF_frame_info_t info = MRF49XA.GetFrameInfo();
+	uint32_t time = info.timestamp;
+	uint16_t length = packet->payloadSize;
+
+	if (info.flags & MRF_INFO_RAW) length *= 2;
+
+	// Report earlier losses first, so they're in order in the stream
+	if (dropped && Free() >= CAPTURE_MAX_ENCODED(CAPTURE_HEADER_LEN + 2 + CAPTURE_CRC_LEN))
+	{
+		Start();
+		for (uint8_t i = 0; i < 4; i++) Put(time >> (8 * i));
+		Put(CAPTURE_RECORD_DROPPED);
+		Put(0);
+		Put(0);
+		Put(0);
+		Put(0);
+		Put(MRF_ADDRESS_BROADCAST);
+		Put(2);
+		Put(dropped & 0xFF);
+		Put(dropped >> 8);
+		Finish();
+
+		dropped = 0;
+	}
+
+	if (dropped || Free() < CAPTURE_MAX_ENCODED(CAPTURE_HEADER_LEN + length + CAPTURE_CRC_LEN))
+	{
+		dropped++;
+		droppedTotal++;
+		return 0;
+	}
+
+	Start();
+	for (uint8_t i = 0; i < 4; i++) Put(time >> (8 * i));
+	Put(CAPTURE_RECORD_FRAME);
+	Put(info.flags);
+	Put(info.status & 0xFF);
+	Put(info.status >> 8);
+	Put(packet->type);
+	Put(packet->address);
+	Put(packet->payloadSize);
+	for (uint16_t i = 0; i < length; i++) Put(packet->payload[i]);
+	Finish();
+
+	return 1;
+}
+
+void Capture_t::Service(void)
+{
+	if (output == 0) return;
+
+	while (tail != head)
+	{
+		int room = output->availableForWrite();
+
+		if (room <= 0) return;
+
+		// Write the contiguous part of the buffer that fits
+		uint16_t end = (head > tail) ? head : CAPTURE_BUFFER_LEN;
+		uint16_t count = end - tail;
+
+		if (count > (uint16_t)room) count = room;
+
+		output->write(&buffer[tail], count);
+		tail = (tail + count) & CAPTURE_MASK;
+	}
+}
+
+uint16_t Capture_t::Dropped(void)
+{
+	return droppedTotal;
+}
+
+// One byte is kept free to tell a full buffer from an empty one
+uint16_t Capture_t::Free(void)
+{
+	return (tail - head - 1) & CAPTURE_MASK;
+}
+
+// The record is COBS encoded straight into the buffer.  The code byte of
+// each block is reserved when the block starts and filled in once the
+// block's length is known.
+void Capture_t::Start(void)
+{
+	crc = 0xFFFF;
+	codeIndex = head;
+	head = (head + 1) & CAPTURE_MASK;
+	code = 1;
+}
+
+void Capture_t::Put(uint8_t data)
+{
+	crc = Crc16Update(crc, data);
+	Encode(data);
+}
+
+void Capture_t::Encode(uint8_t data)
+{
+	if (data != 0)
+	{
+		buffer[head] = data;
+		head = (head + 1) & CAPTURE_MASK;
+		code++;
+
+		if (code != 0xFF) return;
+	}
+
+	// A zero (or a full block) ends the current block
+	buffer[codeIndex] = code;
+	codeIndex = head;
+	head = (head + 1) & CAPTURE_MASK;
+	code = 1;
+}
+
+void Capture_t::Finish(void)
+{
+	uint16_t sum = crc;
+
+	Encode(sum & 0xFF);
+	Encode(sum >> 8);
+
+	buffer[codeIndex] = code;
+	buffer[head] = 0x00;
+	head = (head + 1) & CAPTURE_MASK;
+}
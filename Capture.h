@@ -0,0 +1,82 @@
+/*
+ *  Capture.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+#include "CaptureFormat.h"
+
+// Longest record Record() writes, an ECC frame captured undecoded
+#define CAPTURE_RECORD_MAX  CAPTURE_MAX_ENCODED(CAPTURE_HEADER_LEN + 2 * MRF_PAYLOAD_LEN + CAPTURE_CRC_LEN)
+
+// Size of the buffer between Record() and the serial port, must be a power
+// of 2.  It should hold a few records; if it fills up, records are dropped
+// and counted rather than blocking the caller.  By default it's the
+// smallest from 256 up that still takes the longest record.
+#ifndef CAPTURE_BUFFER_LEN
+#if CAPTURE_RECORD_MAX < 256
+#define CAPTURE_BUFFER_LEN  256
+#elif CAPTURE_RECORD_MAX < 512
+#define CAPTURE_BUFFER_LEN  512
+#else
+#define CAPTURE_BUFFER_LEN  1024
+#endif
+#endif
+
+#if (CAPTURE_BUFFER_LEN & (CAPTURE_BUFFER_LEN - 1)) != 0
+#error "CAPTURE_BUFFER_LEN must be a power of 2"
+#endif
+
+// One byte of the buffer is always kept free
+#if CAPTURE_RECORD_MAX >= CAPTURE_BUFFER_LEN
+#error "CAPTURE_BUFFER_LEN is too small for the longest record at this MRF_PAYLOAD_LEN"
+#endif
+
+// Records received frames in the compact binary format described in
+// CaptureFormat.h.  Records are encoded into a ring buffer, and Service()
+// moves as much as the serial port will take without blocking.  This is
+// about a third of the serial bandwidth of printing the payload as text.
+class Capture_t
+{
+public:
+	void Begin(Print &output);
+
+	// Queues a record for the packet just returned by ReceivePacket().
+	// Returns 0 if the buffer was full and the record was dropped.
+	uint8_t Record(MRF_packet_t *packet);
+
+	// Call often from loop(), never blocks
+	void Service(void);
+
+	uint16_t Dropped(void);		// Total number of dropped records
+private:
+	uint16_t Free(void);
+	void Start(void);
+	void Put(uint8_t data);
+	void Encode(uint8_t data);
+	void Finish(void);
+
+	Print *output;
+	uint8_t buffer[CAPTURE_BUFFER_LEN];
+	uint16_t head;
+	uint16_t tail;
+
+	// State of the record being encoded
+	uint16_t codeIndex;
+	uint8_t code;
+	uint16_t crc;
+
+	uint16_t dropped;			// Since the last DROPPED record
+	uint16_t droppedTotal;
+};
+
+extern Capture_t Capture;
+
+#endif
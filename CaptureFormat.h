@@ -0,0 +1,58 @@
+/*
+ *  CaptureFormat.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Layout of the binary capture stream.  This only depends on stdint so
+ *  host-side tools can parse the stream with the same definitions.
+ *
+ *  Every record is COBS encoded and terminated by a single 0x00 byte, so a
+ *  reader can resynchronize at any delimiter.  Decoded, a record is:
+ *
+ *      offset  size  field
+ *      0       4     time, micros() when the frame's sync word arrived
+ *      4       1     record type (CAPTURE_RECORD_*)
+ *      5       1     flags (CAPTURE_FLAG_*)
+ *      6       2     STSREG at the start of the frame (RSSI, DQD, AFC...)
+ *      8       1     packet type byte, including the header flags
+ *      9       1     destination address
+ *      10      1     payloadSize as sent
+ *      11      n     payload, 2 * payloadSize symbols if CAPTURE_FLAG_RAW
+ *      11 + n  2     CRC-16/CCITT-FALSE of bytes 0 to 10 + n
+ *
+ *  Multi-byte fields are little endian.
+ *
+ */
+
+#ifndef CAPTURE_FORMAT_H
+#define CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+#define CAPTURE_OFFSET_TIME     0
+#define CAPTURE_OFFSET_RECORD   4
+#define CAPTURE_OFFSET_FLAGS    5
+#define CAPTURE_OFFSET_STATUS   6
+#define CAPTURE_OFFSET_TYPE     8
+#define CAPTURE_OFFSET_ADDRESS  9
+#define CAPTURE_OFFSET_LENGTH   10
+#define CAPTURE_HEADER_LEN      11
+#define CAPTURE_CRC_LEN         2
+
+// Record types
+#define CAPTURE_RECORD_FRAME    0x01	// A received frame
+#define CAPTURE_RECORD_DROPPED  0x02	// Payload is a uint16_t count of records
+										// lost because the buffer was full
+
+// Record flags, these match the MRF_INFO_* frame information flags
+#define CAPTURE_FLAG_RAW        0x01	// ECC payload holds undecoded symbols
+
+// Longest payload a record can carry and the resulting record sizes
+#define CAPTURE_MAX_PAYLOAD     255
+#define CAPTURE_MAX_RECORD      (CAPTURE_HEADER_LEN + CAPTURE_MAX_PAYLOAD + CAPTURE_CRC_LEN)
+
+// COBS adds one byte per 254 bytes of data, plus the delimiter
+#define CAPTURE_MAX_ENCODED(n)  ((n) + ((n) / 254) + 2)
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ *  Crc.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Checksums shared by the stored configuration and the capture stream.
+ *  These only depend on stdint so host-side tools can use them as well.
+ *
+ */
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+// CRC-8/MAXIM (Dallas 1-wire), polynomial x^8 + x^5 + x^4 + 1, reflected.
+// Same result as avr-libc's _crc_ibutton_update().
+static inline uint8_t Crc8Update(uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
+		else crc >>= 1;
+	}
+
+	return crc;
+}
+
+static inline uint8_t Crc8(const uint8_t *data, uint16_t length)
+{
+	uint8_t crc = 0x00;
+
+	while (length--) crc = Crc8Update(crc, *data++);
+
+	return crc;
+}
+
+// CRC-16/CCITT-FALSE, polynomial x^16 + x^12 + x^5 + 1, initial 0xFFFF.
+// Same result as avr-libc's _crc_xmodem_update() started from 0xFFFF.
+static inline uint16_t Crc16Update(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t)data << 8;
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+		else crc <<= 1;
+	}
+
+	return crc;
+}
+
+static inline uint16_t Crc16(const uint8_t *data, uint16_t length)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (length--) crc = Crc16Update(crc, *data++);
+
+	return crc;
+}
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ *  Crypto.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "Crypto.h"
+
+Crypto_t Crypto = Crypto_t();
+
+// Marks counter blocks.  The first MAC block has the payload type there,
+// which is never above PACKET_TYPE_MASK.
+#define CRYPTO_CTR_MARKER  0xFF
+
+static inline uint32_t Ror(uint32_t x, uint8_t r)
+{
+	return (x >> r) | (x << (32 - r));
+}
+
+static inline uint32_t Rol(uint32_t x, uint8_t r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+// Words are stored little endian, block = (x, y) with y first
+static inline uint32_t LoadWord(const uint8_t *bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | 
+	       ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static inline void StoreWord(uint8_t *bytes, uint32_t word)
+{
+	bytes[0] = word;
+	bytes[1] = word >> 8;
+	bytes[2] = word >> 16;
+	bytes[3] = word >> 24;
+}
+
+void Crypto_t::SetKey(const uint8_t *key, MRF_epoch_source_t source)
+{
+	uint32_t l[3];
+	uint32_t k;
+
+	keyed = 0;
+	if (key == NULL) return;
+
+	// Key words (l2, l1, l0, k0), k0 in the first 4 bytes
+	k    = LoadWord(key);
+	l[0] = LoadWord(key + 4);
+	l[1] = LoadWord(key + 8);
+	l[2] = LoadWord(key + 12);
+
+	for (uint8_t i = 0; i < CRYPTO_ROUNDS; i++)
+	{
+		roundKeys[i] = k;
+
+		uint32_t next = (k + Ror(l[i % 3], 8)) ^ i;
+		k = Rol(k, 3) ^ next;
+		l[i % 3] = next;
+	}
+
+	epochSource = source;
+	epoch = 0;
+	counter = 0;
+	keyed = 1;
+}
+
+void Crypto_t::ReserveEpoch(void)
+{
+	if (!keyed || epochSource == NULL) return;
+
+	epoch = epochSource();
+	epochSource = NULL;
+}
+
+uint8_t Crypto_t::HasKey(void)
+{
+	return keyed;
+}
+
+// Nonce: sender, epoch (2 bytes), frame counter (3 bytes).  The sender
+// keeps nodes sharing the key apart, the epoch keeps reboots apart.
+uint8_t Crypto_t::NextNonce(volatile uint8_t *nonce, uint8_t sender)
+{
+	if (counter >= 0x01000000UL) return 0;
+
+	ReserveEpoch();
+
+	nonce[0] = sender;
+	nonce[1] = epoch;
+	nonce[2] = epoch >> 8;
+	nonce[3] = counter;
+	nonce[4] = counter >> 8;
+	nonce[5] = counter >> 16;
+
+	counter++;
+
+	return 1;
+}
+
+void Crypto_t::EncryptBlock(uint8_t *block)
+{
+	uint32_t y = LoadWord(block);
+	uint32_t x = LoadWord(block + 4);
+
+	for (uint8_t i = 0; i < CRYPTO_ROUNDS; i++)
+	{
+		x = (Ror(x, 8) + y) ^ roundKeys[i];
+		y = Rol(y, 3) ^ x;
+	}
+
+	StoreWord(block, y);
+	StoreWord(block + 4, x);
+}
+
+// The MAC starts from the encrypted (nonce, type, length) block, so frames
+// of different lengths never share a MAC prefix.
+void Crypto_t::Start(MRF_cipher_t *state, const volatile uint8_t *nonce, uint8_t type, uint8_t length)
+{
+	for (uint8_t i = 0; i < CRYPTO_NONCE_LEN; i++) 
+	{
+		state->nonce[i] = nonce[i];
+		state->mac[i]   = nonce[i];
+	}
+
+	state->mac[CRYPTO_NONCE_LEN]     = type & PACKET_TYPE_MASK;
+	state->mac[CRYPTO_NONCE_LEN + 1] = length;
+	state->index = 0;
+
+	EncryptBlock(state->mac);
+}
+
+// Keystream block n is E(nonce, marker, n), computed on its first byte
+uint8_t Crypto_t::Keystream(MRF_cipher_t *state)
+{
+	uint8_t offset = state->index & (CRYPTO_BLOCK_LEN - 1);
+
+	if (offset == 0) 
+	{
+		for (uint8_t i = 0; i < CRYPTO_NONCE_LEN; i++) state->keystream[i] = state->nonce[i];
+
+		state->keystream[CRYPTO_NONCE_LEN]     = CRYPTO_CTR_MARKER;
+		state->keystream[CRYPTO_NONCE_LEN + 1] = state->index / CRYPTO_BLOCK_LEN;
+
+		EncryptBlock(state->keystream);
+	}
+
+	return state->keystream[offset];
+}
+
+// Adds a plaintext byte to the MAC, a full block is encrypted on its last
+// byte, so it never coincides with a keystream block
+void Crypto_t::Absorb(MRF_cipher_t *state, uint8_t data)
+{
+	uint8_t offset = state->index & (CRYPTO_BLOCK_LEN - 1);
+
+	state->mac[offset] ^= data;
+	state->index++;
+
+	if (offset == CRYPTO_BLOCK_LEN - 1) EncryptBlock(state->mac);
+}
+
+uint8_t Crypto_t::Encrypt(MRF_cipher_t *state, uint8_t data)
+{
+	uint8_t out = data ^ Keystream(state);
+
+	Absorb(state, data);
+
+	return out;
+}
+
+uint8_t Crypto_t::Decrypt(MRF_cipher_t *state, uint8_t data)
+{
+	uint8_t out = data ^ Keystream(state);
+
+	Absorb(state, out);
+
+	return out;
+}
+
+// Pads the last block with zeros, the first CRYPTO_TAG_LEN bytes of mac
+// are the tag
+void Crypto_t::Finish(MRF_cipher_t *state)
+{
+	if (state->index & (CRYPTO_BLOCK_LEN - 1)) EncryptBlock(state->mac);
+}
@@ -0,0 +1,85 @@
+/*
+ *  Crypto.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+#include <Arduino.h>
+#include "PacketTypes.h"
+
+// Speck64/128: 64 bit blocks, 128 bit key, 27 rounds.  The round keys are
+// expanded once by SetKey() and take 108 bytes of SRAM.
+#define CRYPTO_KEY_LEN     16
+#define CRYPTO_BLOCK_LEN   8
+#define CRYPTO_ROUNDS      27
+
+// Reserves a new nonce epoch and returns it, see SetKey()
+typedef uint16_t (*MRF_epoch_source_t)(void);
+
+// State of the frame being encrypted or decrypted, one for each direction
+typedef struct {
+	uint8_t nonce[CRYPTO_NONCE_LEN];
+	uint8_t index;							// Payload bytes processed
+	uint8_t keystream[CRYPTO_BLOCK_LEN];
+	uint8_t mac[CRYPTO_BLOCK_LEN];			// CBC-MAC, the tag when finished
+} MRF_cipher_t;
+
+// Authenticated encryption for PACKET_FLAG_ENCRYPTED frames.  The payload
+// is encrypted in counter mode and authenticated with a CBC-MAC over the
+// payload type, length and plaintext (the same construction as CCM), both
+// keyed with the one network key.  The header fields that relays change
+// (address, hops) aren't authenticated.
+//
+// The work is done per byte from the interrupt: one block encryption for
+// the keystream on the first byte of every 8, and one for the MAC on the
+// last, so a single interrupt never does more than one.  The figures that
+// follow are estimates from the instruction count of a round (32 bit add,
+// rotate and xor on an 8 bit core), not measurements: about 1500 cycles
+// (95us at 16 MHz) per block, 375 cycles per payload byte on average,
+// enough for about 57.6 kbps.  ECC frames carry half a payload byte per
+// FIFO byte and so do proportionally better.
+class Crypto_t
+{
+public:
+	// Sets the network key.  The nonce epoch must be different every time
+	// the same key is set; it's taken from source when the first nonce is
+	// needed, so a node that never sends an encrypted frame never reserves
+	// one (Registers.h keeps it in EEPROM).  A NULL key disables encryption.
+	void SetKey(const uint8_t *key, MRF_epoch_source_t source);
+	uint8_t HasKey(void);
+
+	// Reserves the epoch if that's still to be done.  The driver calls it
+	// before claiming the transmitter, so the EEPROM write isn't made
+	// while the radio waits.
+	void ReserveEpoch(void);
+
+	// Fills in a fresh nonce for a frame from sender.  Returns 0 if the
+	// nonces of this epoch are used up (2^24 frames).
+	uint8_t NextNonce(volatile uint8_t *nonce, uint8_t sender);
+
+	// Per frame operations, used by the driver
+	void Start(MRF_cipher_t *state, const volatile uint8_t *nonce, uint8_t type, uint8_t length);
+	uint8_t Encrypt(MRF_cipher_t *state, uint8_t data);
+	uint8_t Decrypt(MRF_cipher_t *state, uint8_t data);
+	void Finish(MRF_cipher_t *state);
+
+	void EncryptBlock(uint8_t *block);
+private:
+	uint8_t Keystream(MRF_cipher_t *state);
+	void Absorb(MRF_cipher_t *state, uint8_t data);
+
+	uint32_t roundKeys[CRYPTO_ROUNDS];
+	uint8_t keyed;
+	MRF_epoch_source_t epochSource;		// Until the epoch has been reserved
+	uint16_t epoch;
+	uint32_t counter;
+};
+
+extern Crypto_t Crypto;
+
+#endif
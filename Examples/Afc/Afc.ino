@@ -0,0 +1,78 @@
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "Afc.h"
+
+// Frequency tracking between two nodes.  Set NODE_ADDRESS and PEER_ADDRESS
+// the other way round on the second board.  Each node pings its peer, with
+// a relay header so the receiver knows who sent it, and prints the offset
+// it has learned for every peer.  Only the first node tunes; the second
+// one just measures, and should see its peer settle close to zero.
+#define NODE_ADDRESS     1
+#define PEER_ADDRESS     2
+#define TUNE_TO_PEER     (NODE_ADDRESS < PEER_ADDRESS)
+#define CHANNEL          0x348		// FREQB of the default profile
+#define SEND_INTERVAL    2000
+
+unsigned long lastSend;
+uint8_t afcStarted;
+
+void packetReceived(MRF_packet_t *packet)
+{
+	Afc.PacketReceived(packet);
+
+	Serial.print("\n\rFrom ");
+	Serial.print(packet->source, DEC);
+	Serial.print(", offset ");
+	Serial.print(MRF_AFC_OFFSET(MRF49XA.GetFrameInfo().status), DEC);
+}
+
+void setup()
+{
+	SPI.begin();
+	Serial.begin(9600);
+
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
+
+	MRF49XA.SetAddress(NODE_ADDRESS);
+	MRF49XA.OnReceive(packetReceived);
+}
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+	// The AFC registers go on top of the ones the bring-up wrote
+	if (!afcStarted)
+	{
+		// Hardware AFC while receiving, within +15/-16 Fres
+		Afc.Begin(MRF_AUTOMS_RECV, MRF_ARFO_15to16, CHANNEL);
+		afcStarted = 1;
+		lastSend = millis();
+	}
+
+	MRF49XA.Dispatch();
+
+	if (millis() - lastSend >= SEND_INTERVAL && MRF49XA.IsIdle())
+	{
+		MRF_packet_t packet;
+
+		lastSend = millis();
+
+		// Stays on the peer's frequency for the reply
+		if (TUNE_TO_PEER) Afc.Tune(PEER_ADDRESS);
+
+		packet.type = PACKET_TYPE_PACKET | PACKET_FLAG_ADDRESSED | PACKET_FLAG_RELAY;
+		packet.address = PEER_ADDRESS;
+		packet.target = PEER_ADDRESS;
+		packet.hops = 0;
+		packet.payloadSize = 4;
+		memcpy(packet.payload, "ping", 4);
+		MRF49XA.TransmitPacket(&packet);
+
+		Afc.Report(Serial);
+	}
+}
@@ -0,0 +1,77 @@
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "Aggregate.h"
+
+// Small sensor readings packed into batch frames.  Build one board with
+// SENDER set to 1 and the other with 0.  The sender takes a reading every
+// READ_INTERVAL milliseconds and none of them waits longer than LATENCY;
+// the receiver prints every reading it gets.
+#define SENDER         1
+#define READ_INTERVAL  50
+#define LATENCY        500
+
+typedef struct {
+	uint16_t sequence;
+	uint16_t value;
+	uint32_t time;
+} reading_t;
+
+unsigned long lastRead;
+uint16_t sequence;
+
+void messageReceived(const uint8_t *message, uint8_t length)
+{
+	reading_t reading;
+
+	if (length != sizeof(reading)) return;
+	memcpy(&reading, message, sizeof(reading));
+
+	Serial.print("\n\r");
+	Serial.print(reading.sequence, DEC);
+	Serial.print(": ");
+	Serial.print(reading.value, DEC);
+}
+
+void packetReceived(MRF_packet_t *packet)
+{
+	Aggregate.Unpack(packet, messageReceived);
+}
+
+void setup()
+{
+	SPI.begin();
+	Serial.begin(9600);
+
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
+
+	MRF49XA.OnReceive(packetReceived);
+
+	Aggregate.Begin(PACKET_TYPE_BATCH | PACKET_FLAG_WHITENED, MRF_ADDRESS_BROADCAST, LATENCY);
+	lastRead = millis();
+}
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+	MRF49XA.Dispatch();
+
+	if (SENDER && millis() - lastRead >= READ_INTERVAL)
+	{
+		reading_t reading;
+
+		lastRead = millis();
+
+		reading.sequence = sequence++;
+		reading.value    = analogRead(A0);
+		reading.time     = lastRead;
+
+		Aggregate.Add((const uint8_t *)&reading, sizeof(reading));
+	}
+
+	Aggregate.Service();
+}
@@ -0,0 +1,92 @@
+// Times the three Hamming codec policies on the bench.  Each one encodes
+// all 16 nibbles and checks all 256 symbols with interrupts off, Timer1
+// counts CPU cycles.  The results of every codec are compared with the
+// flash tables, so a wrong table read shows up as a mismatch.
+//
+// Code size can't be measured from the sketch.  Build the driver with
+// HAMMING_CODEC set to each policy (see Hamming.h) and compare the sizes
+// the IDE reports.
+
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Hamming.h"
+
+const char headerString[]	PROGMEM = "\n\rCodec  Encode x16  Check x256  Flash  SRAM  Errors";
+const char flashString[]	PROGMEM = "\n\rFlash  ";
+const char ramString[]		PROGMEM = "\n\rRAM    ";
+const char logicString[]	PROGMEM = "\n\rLogic  ";
+const char sepString[]		PROGMEM = "  ";
+
+HammingCodec_t<HammingFlash_t> flashCodec;
+HammingCodec_t<HammingRam_t> ramCodec;
+HammingCodec_t<HammingLogic_t> logicCodec;
+
+volatile uint8_t sink;
+
+void printString(const char *string)
+{
+	char c;
+
+	while ((c = pgm_read_byte(string++))) Serial.write(c);
+}
+
+// Prints the cycles for the whole encode and check runs, loop included
+template <class Policy> void bench(HammingCodec_t<Policy> &codec, const char *name, uint16_t flash, uint16_t sram)
+{
+	uint16_t start, encode, check;
+	uint8_t errors = 0;
+	uint8_t i, acc = 0;
+
+	noInterrupts();
+
+	start = TCNT1;
+	for (i = 0; i < 16; i++) acc ^= codec.EncodeNibble(i);
+	encode = TCNT1 - start;
+
+	start = TCNT1;
+	i = 0;
+	do { acc ^= codec.CheckNibble(i); } while (++i);
+	check = TCNT1 - start;
+
+	interrupts();
+
+	sink = acc;
+
+	for (i = 0; i < 16; i++) errors += codec.EncodeNibble(i) != pgm_read_byte(&hammingGenerator[i]);
+
+	i = 0;
+	do { errors += codec.CheckNibble(i) != pgm_read_byte(&hammingCheck[i]); } while (++i);
+
+	printString(name);
+	Serial.print(encode);
+	printString(sepString);
+	Serial.print(check);
+	printString(sepString);
+	Serial.print(flash);
+	printString(sepString);
+	Serial.print(sram);
+	printString(sepString);
+	Serial.print(errors);
+}
+
+void setup()
+{
+	Serial.begin(9600);
+
+	// Timer1 at the CPU clock
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+
+	printString(headerString);
+
+	// Table bytes only, the code is the same order of size for all three
+	bench(flashCodec, flashString, sizeof(hammingGenerator) + sizeof(hammingCheck), 0);
+	bench(ramCodec, ramString, sizeof(hammingGenerator) + sizeof(hammingCheck),
+		sizeof(HammingRam_t::generator) + sizeof(HammingRam_t::check));
+	bench(logicCodec, logicString, 0, 0);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,145 @@
+// Measures the worst-case FIFO interrupt for every kind of frame.  Build
+// the driver with MRF_ISR_PROFILE uncommented in MRF49XA_definitions.h
+// and load this on two boards, with BENCH_ADDRESS changed on one of them.
+// Each board sends a full frame of every kind in turn and prints the
+// worst handler call seen sending and receiving, in CPU cycles.  The
+// handlers are specialized for the frame's flags; uncomment
+// MRF_ISR_GENERIC as well to get the figures of the version that tests
+// them on every byte, and compare.
+//
+// The time of one Speck block is printed first, the largest single step
+// of the encrypted handlers (see Crypto.h).
+
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "Crypto.h"
+
+// Encrypted frames need a node address, different on the two boards
+#define BENCH_ADDRESS	0x01
+
+// Time between frames and between reports, in milliseconds
+#define FRAME_INTERVAL	100
+#define REPORT_INTERVAL	5000
+
+const char blockString[]	PROGMEM = "\n\rSpeck block: ";
+const char offString[]		PROGMEM = "\n\rThe driver was built without MRF_ISR_PROFILE";
+const char headerString[]	PROGMEM = "\n\rECC Enc White    TX payload  RX payload";
+const char otherString[]	PROGMEM = "\n\rOther handlers: ";
+const char sepString[]		PROGMEM = "  ";
+
+// Only used if no key has been saved yet
+const uint8_t benchKey[CRYPTO_KEY_LEN] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+};
+
+MRF_packet_t packet;
+uint8_t kind;
+uint32_t lastFrame;
+uint32_t lastReport;
+
+void printString(const char *string)
+{
+	char c;
+
+	while ((c = pgm_read_byte(string++))) Serial.write(c);
+}
+
+void setup()
+{
+	uint8_t block[CRYPTO_BLOCK_LEN] = { 0 };
+	uint16_t start, cycles;
+
+	SPI.begin();
+	Serial.begin(9600);
+
+	Registers.Begin();
+
+	if (!Crypto.HasKey()) Registers.SetKey(benchKey);
+
+	MRF49XA.SetAddress(BENCH_ADDRESS);
+
+	// Timer1 at the CPU clock, the driver sets it up the same way when
+	// profiling
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+
+	noInterrupts();
+
+	start = TCNT1;
+	Crypto.EncryptBlock(block);
+	cycles = TCNT1 - start;
+
+	interrupts();
+
+	printString(blockString);
+	Serial.print(cycles);
+
+	for (uint8_t i = 0; i < MRF_PAYLOAD_LEN; i++) packet.payload[i] = i;
+	packet.payloadSize = MRF_PAYLOAD_LEN;
+
+#ifndef MRF_ISR_PROFILE
+	printString(offString);
+#endif
+}
+
+#ifdef MRF_ISR_PROFILE
+void report(void)
+{
+	MRF_isr_profile_t profile;
+
+	MRF49XA.GetIsrProfile(&profile);
+
+	printString(headerString);
+
+	for (uint8_t i = 0; i < MRF_ISR_KINDS; i++)
+	{
+		Serial.print("\n\r ");
+		Serial.print((i >> 2) & 1);
+		Serial.print("   ");
+		Serial.print((i >> 1) & 1);
+		Serial.print("    ");
+		Serial.print(i & 1);
+		Serial.print("      ");
+		Serial.print(profile.txPayload[i]);
+		printString(sepString);
+		Serial.print(profile.rxPayload[i]);
+	}
+
+	printString(otherString);
+	Serial.print(profile.other);
+}
+#endif
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+#ifdef MRF_ISR_PROFILE
+	// Received frames are only there to be timed
+	MRF49XA.ReceivePacket();
+
+	if (millis() - lastFrame >= FRAME_INTERVAL && MRF49XA.IsIdle())
+	{
+		lastFrame = millis();
+
+		// The same bits as MRF_ISR_KIND()
+		packet.type = (kind & 4) ? PACKET_TYPE_PACKET_ECC : PACKET_TYPE_PACKET;
+		if (kind & 2) packet.type |= PACKET_FLAG_ENCRYPTED;
+		if (kind & 1) packet.type |= PACKET_FLAG_WHITENED;
+
+		MRF49XA.TransmitPacket(&packet);
+
+		kind = (kind + 1) % MRF_ISR_KINDS;
+	}
+
+	if (millis() - lastReport >= REPORT_INTERVAL)
+	{
+		lastReport = millis();
+		report();
+	}
+#endif
+}
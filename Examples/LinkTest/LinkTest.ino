@@ -0,0 +1,51 @@
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "LinkTest.h"
+
+// Measures the link to a node running PingPong in MODE_TEST_PING (or any
+// node with MRF49XA.PacketReflect(1)).  Sends a 32 byte ECC test frame
+// every 100ms and prints the statistics every 10 seconds.
+#define TEST_SIZE      32
+#define TEST_INTERVAL  100
+#define TEST_TYPE      PACKET_TYPE_TEST_ECC
+#define REPORT_PERIOD  10000
+
+unsigned long lastReport;
+
+// Runs from MRF49XA.Dispatch(), outside the interrupt
+void packetReceived(MRF_packet_t *packet)
+{
+	LinkTest.PacketReceived(packet);
+}
+
+void setup()
+{
+	SPI.begin();
+	Serial.begin(9600);
+
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
+
+	MRF49XA.OnReceive(packetReceived);
+
+	LinkTest.Start(TEST_SIZE, TEST_INTERVAL, TEST_TYPE);
+	lastReport = millis();
+}
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+	MRF49XA.Dispatch();
+
+	LinkTest.Service();
+
+	if (millis() - lastReport >= REPORT_PERIOD)
+	{
+		lastReport = millis();
+		LinkTest.Report(Serial);
+	}
+}
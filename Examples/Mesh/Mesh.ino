@@ -0,0 +1,63 @@
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "Mesh.h"
+
+// A mesh node.  Every node needs its own address; set NODE_ADDRESS and
+// PEER_ADDRESS differently on each board.  The node sends a short message
+// to its peer every few seconds and prints what it receives and its route
+// table.
+#define NODE_ADDRESS     1
+#define PEER_ADDRESS     2
+#define BEACON_INTERVAL  5000
+#define SEND_INTERVAL    3000
+
+unsigned long lastSend;
+
+void packetReceived(MRF_packet_t *packet)
+{
+	// Route beacons are for the mesh layer
+	if (Mesh.PacketReceived(packet)) return;
+
+	Serial.print("\n\rFrom ");
+	Serial.print(packet->source, DEC);
+	Serial.print(" in ");
+	Serial.print(RELAY_HOPS(packet->hops) + 1, DEC);
+	Serial.print(" hops: ");
+
+	for (int i = 0; i < packet->payloadSize; i++) Serial.write(packet->payload[i]);
+}
+
+void setup()
+{
+	SPI.begin();
+	Serial.begin(9600);
+
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
+
+	MRF49XA.SetAddress(NODE_ADDRESS);
+	MRF49XA.OnReceive(packetReceived);
+
+	Mesh.Begin(BEACON_INTERVAL);
+	lastSend = millis();
+}
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+	MRF49XA.Dispatch();
+	Mesh.Service();
+
+	if (millis() - lastSend >= SEND_INTERVAL)
+	{
+		uint8_t message[] = "hello";
+
+		lastSend = millis();
+		Mesh.Send(PEER_ADDRESS, PACKET_TYPE_PACKET, message, sizeof(message) - 1);
+		Mesh.Report(Serial);
+	}
+}
@@ -4,6 +4,7 @@
 #include "Registers.h"
 #include "Packet.h"
 #include "Modes.h"
+#include "Capture.h"
 
 const char pingString[]			PROGMEM = "PINGING: ";
 
@@ -16,23 +17,30 @@ const char packetLengthString[]	PROGMEM = "length ";
 const char invalidModeString[]	PROGMEM = " Invalid mode, ";
 
 volatile enum device_mode mode = MODE_SERIAL;
-volatile uint8_t counter = 0;
-volatile MRF_packet_t packet;
+volatile MRF_counter_t counter = 0;
 
 void setup()
 {
 	SPI.begin();
 	Serial.begin(9600);
-	MRF49XA.Initialize();
 
-	Registers.ApplySavedRegisters();
-	MRF49XA.Reset();
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
 
 	mode = Registers.GetBootState();
+
+	// Captured frames are written in binary, see CaptureFormat.h
+	Capture.Begin(Serial);
+
+	// Link test requests are echoed by the driver, see the LinkTest example
+	MRF49XA.PacketReflect(mode == MODE_TEST_PING);
 }
 
 void loop()
 {
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
 	if (mode == MODE_TEST_ALT  || mode == MODE_TEST_ZERO || mode == MODE_TEST_ONE  || mode == MODE_CAPTURE   || mode == MODE_TEST_PING ) {
 		// Test for a new packet
 		MRF_packet_t *rx_packet = MRF49XA.ReceivePacket();
@@ -46,20 +54,23 @@ void loop()
 					printPacket(rx_packet);
 					break;
 				case MODE_CAPTURE:
-					printPacket(rx_packet);
+					Capture.Record(rx_packet);
 					break;
 				default:
 					// Other menu modes would end up here, ignore the packet
 					break;
 			}
 		}
+
+		// Drain the capture buffer without blocking reception
+		Capture.Service();
 	}
 	// These modes are responsible for actually using the RF interface
 	else {
 		switch (mode) {
 			case MODE_SERIAL:
 			case MODE_SERIAL_ECC:
-				if (Serial.available() > 0) Packet.ByteReceived((uint8_t)Serial.read(), counter, mode, packet);
+				if (Serial.available() > 0) Packet.ByteReceived((uint8_t)Serial.read(), counter, mode);
 				break;							
 			default:
 				// This would catch any weird modes
@@ -74,7 +85,7 @@ void loop()
 void printPacket(MRF_packet_t *rx_packet)
 {
 	// Print a label for the packet type
-	switch (rx_packet->type) 
+	switch (rx_packet->type & PACKET_TYPE_MASK) 
 	{
 		case PACKET_TYPE_SERIAL:
 			Serial.print(typeSerialString);
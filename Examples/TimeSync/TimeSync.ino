@@ -0,0 +1,66 @@
+#include <SPI.h>
+#include <EEPROM.h>
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "TimeSync.h"
+
+// Time synchronization.  Flash one board with NODE_ADDRESS 1 and
+// REFERENCE_ADDRESS MRF_ADDRESS_BROADCAST, it only answers; flash the
+// others with their own address and REFERENCE_ADDRESS 1.  The followers
+// toggle the LED at every second of the reference's clock, so the LEDs
+// of all boards blink together, and print how well they track.
+#define NODE_ADDRESS       2
+#define REFERENCE_ADDRESS  1
+#define SYNC_INTERVAL      1000
+#define REPORT_INTERVAL    10000
+
+uint32_t nextTick;
+unsigned long lastReport;
+
+void packetReceived(MRF_packet_t *packet)
+{
+	TimeSync.PacketReceived(packet);
+}
+
+void setup()
+{
+	SPI.begin();
+	Serial.begin(9600);
+	pinMode(LED_BUILTIN, OUTPUT);
+
+	// Starts the transceiver with the saved registers, loop() finishes it
+	Registers.Begin();
+
+	MRF49XA.SetAddress(NODE_ADDRESS);
+	MRF49XA.OnReceive(packetReceived);
+
+	TimeSync.Begin(REFERENCE_ADDRESS, SYNC_INTERVAL);
+	lastReport = millis();
+}
+
+void loop()
+{
+	// Still bringing the transceiver up
+	if (!MRF49XA.Startup()) return;
+
+	MRF49XA.Dispatch();
+	TimeSync.Service();
+
+	if (TimeSync.IsSynchronized())
+	{
+		uint32_t now = TimeSync.Now();
+
+		// The next whole second of the reference's clock
+		if ((int32_t)(now - nextTick) >= 0)
+		{
+			nextTick = (now / 1000000UL + 1) * 1000000UL;
+			digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+		}
+	}
+
+	if (millis() - lastReport >= REPORT_INTERVAL)
+	{
+		lastReport = millis();
+		TimeSync.Report(Serial);
+	}
+}
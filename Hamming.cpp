@@ -9,20 +9,16 @@
  *
  */
 
+// The tables are shared with the host-side tools
+#ifdef ARDUINO
 #include <Arduino.h>
-#include "Hamming.h"
-
-#ifdef __AVR__
-#include <avr/pgmspace.h>
-#endif
-
-Hamming_t Hamming = Hamming_t();
-
-#ifdef __AVR__
-static const uint8_t generator[16] PROGMEM = {
 #else
-static const uint8_t generator[16] = {
+#include <stdint.h>
 #endif
+#include "Hamming.h"
+#include <string.h>
+
+const uint8_t hammingGenerator[16] PROGMEM = {
 	0x00,
    	0x17,
    	0x2B,
@@ -67,11 +63,7 @@ static const uint8_t generator[16] = {
 // nibble).  If the symptom has 2 bits, it's a double-bit error and we're not
 // confident in its value.  We cannot distinguish between 1 and 3 bit errors,
 // and they will be blindly modified, sometimes incorrectly.
-#ifdef __AVR__
-static const uint8_t check[256] PROGMEM =
-#else
-static const uint8_t check[256] =
-#endif
+const uint8_t hammingCheck[256] PROGMEM =
 {
 	0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x71, 0x80, 0x90, 0xa0, 0xb2, 0xc0, 0xd4, 0xe8, 0xf0, // 12 0's
    	0x70, 0x61, 0x51, 0x41, 0x31, 0x21, 0x11, 0x01, 0xf1, 0xe9, 0xd5, 0xc1, 0xb3, 0xa1, 0x91, 0x81, // 12 1's
@@ -92,30 +84,19 @@ static const uint8_t check[256] =
 //  5 0s, 5 7s, 5 Bs, 5 Cs, 5 Ds, 5 As, 5 6s, 5 1s, 5 Es, 5 9s, 5 5s, 5 2s, 5 3s, 5 4s, 5 8s, 5 Fs
 };
 
-uint8_t Hamming_t::EncodeNibble(uint8_t nibble)
-{
-	return generator[nibble & 0x0F];
-}
+uint8_t HammingRam_t::generator[16];
+uint8_t HammingRam_t::check[256];
 
-uint16_t Hamming_t::EncodeByte(uint8_t data)
+// The SRAM copy is made when the codec is constructed, before setup() runs
+void HammingRam_t::Begin(void)
 {
-	uint16_t temp = 0x0000;
-
-	temp |= generator[(data >> 4) & 0x0F] << 8;
-	temp |= generator[ data       & 0x0F];
-
-	return temp;
-}
-
-uint8_t Hamming_t::DecodeNibble(uint8_t nibble)
-{
-	return check[nibble] & 0x0F;
+#ifdef __AVR__
+	memcpy_P(generator, hammingGenerator, sizeof(generator));
+	memcpy_P(check, hammingCheck, sizeof(check));
+#else
+	memcpy(generator, hammingGenerator, sizeof(generator));
+	memcpy(check, hammingCheck, sizeof(check));
+#endif
 }
 
-uint16_t Hamming_t::DecodeByte(uint16_t symbol)
-{
-	uint16_t highNibble = (check[symbol >> 8] & 0xFF) << 4;
-	uint8_t lowNibble = check[symbol & 0xFF] & 0x0F;
-
-	return highNibble | lowNibble;
-}
+Hamming_t Hamming = Hamming_t();
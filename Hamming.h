@@ -12,18 +12,151 @@
 #ifndef HAMMING_H
 #define HAMMING_H
 
+// The tables are shared with the host-side tools
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stdint.h>
+#endif
 
-class Hamming_t
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#endif
+#endif
+
+// Generator and check tables, in program memory on AVR
+extern const uint8_t hammingGenerator[16] PROGMEM;
+extern const uint8_t hammingCheck[256] PROGMEM;
+
+// Codec policies.  Encode() maps a data nibble to its codeword, Check()
+// maps a codeword to the corrected nibble with the syndrome in the high
+// nibble.  They all give the same results, they differ in where the cost
+// goes:
+//
+//   HammingFlash_t  reads the tables from program memory, 272 bytes flash
+//   HammingRam_t    copies the tables to SRAM, 272 bytes flash + 272 SRAM
+//   HammingLogic_t  computes both from the parity masks, no tables
+//
+// See the HammingBench example for the cycle counts.
+struct HammingFlash_t
+{
+	static void Begin(void) { }
+
+	static inline uint8_t Encode(uint8_t nibble)
+	{
+		return pgm_read_byte(&hammingGenerator[nibble & 0x0F]);
+	}
+
+	static inline uint8_t Check(uint8_t symbol)
+	{
+		return pgm_read_byte(&hammingCheck[symbol]);
+	}
+};
+
+struct HammingRam_t
+{
+	static uint8_t generator[16];
+	static uint8_t check[256];
+
+	static void Begin(void);
+
+	static inline uint8_t Encode(uint8_t nibble)
+	{
+		return generator[nibble & 0x0F];
+	}
+
+	static inline uint8_t Check(uint8_t symbol)
+	{
+		return check[symbol];
+	}
+};
+
+struct HammingLogic_t
+{
+	static void Begin(void) { }
+
+	// Each data bit adds its column of parity bits
+	static inline uint8_t Encode(uint8_t nibble)
+	{
+		uint8_t parity = 0;
+
+		if (nibble & 0x01) parity ^= 0x07;
+		if (nibble & 0x02) parity ^= 0x0B;
+		if (nibble & 0x04) parity ^= 0x0D;
+		if (nibble & 0x08) parity ^= 0x0E;
+
+		return ((nibble & 0x0F) << 4) | parity;
+	}
+
+	// A syndrome equal to a data column flips that data bit.  Single parity
+	// bit errors and double errors keep the data as received, the same
+	// choice the check table makes.
+	static inline uint8_t Check(uint8_t symbol)
+	{
+		uint8_t data = symbol >> 4;
+		uint8_t syndrome = (symbol ^ Encode(data)) & 0x0F;
+
+		switch (syndrome) 
+		{
+			case 0x07: data ^= 0x01; break;
+			case 0x0B: data ^= 0x02; break;
+			case 0x0D: data ^= 0x04; break;
+			case 0x0E: data ^= 0x08; break;
+		}
+
+		return (syndrome << 4) | data;
+	}
+};
+
+template <class Policy>
+class HammingCodec_t
 {
 public:
-	uint8_t EncodeNibble(uint8_t nibble);
-	uint16_t EncodeByte(uint8_t data);
+	HammingCodec_t() { Policy::Begin(); }
+
+	uint8_t EncodeNibble(uint8_t nibble)
+	{
+		return Policy::Encode(nibble);
+	}
+
+	uint16_t EncodeByte(uint8_t data)
+	{
+		return (Policy::Encode(data >> 4) << 8) | Policy::Encode(data & 0x0F);
+	}
+
+	uint8_t DecodeNibble(uint8_t symbol)
+	{
+		return Policy::Check(symbol) & 0x0F;
+	}
 
-	uint8_t DecodeNibble(uint8_t nibble);
-	uint16_t DecodeByte(uint16_t symbol);
+	// Returns the decoded nibble in the low 4 bits and the syndrome in the
+	// high 4 bits.  The syndrome is zero only if the symbol was a valid
+	// codeword.
+	uint8_t CheckNibble(uint8_t symbol)
+	{
+		return Policy::Check(symbol);
+	}
+
+	uint16_t DecodeByte(uint16_t symbol)
+	{
+		return ((Policy::Check(symbol >> 8) & 0x0F) << 4) | (Policy::Check(symbol & 0xFF) & 0x0F);
+	}
 };
 
+// The codec used by the driver, fixed at compile time.  Edit it here or
+// set it as a compiler flag for the whole build to use another policy.
+#ifndef HAMMING_CODEC
+#define HAMMING_CODEC HammingFlash_t
+#endif
+
+typedef HammingCodec_t<HAMMING_CODEC> Hamming_t;
+
 extern Hamming_t Hamming;
 
-#endif
\ No newline at end of file
+#endif
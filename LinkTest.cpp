@@ -0,0 +1,172 @@
+/*
+ *  LinkTest.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "LinkTest.h"
+#include "MRF49XA.h"
+
+LinkTest_t LinkTest = LinkTest_t();
+
+void LinkTest_t::Start(uint8_t size, uint16_t interval, uint8_t type)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.rttMin = 0xFFFFFFFF;
+
+	sampleCount = 0;
+	sampleIndex = 0;
+
+	this->size     = size;
+	this->type     = type;
+	this->interval = interval;
+
+	sequence = 0;
+	expected = 0;
+	started  = millis();
+	lastSent = started - interval;
+	running  = 1;
+}
+
+void LinkTest_t::Stop(void)
+{
+	stats.elapsed = millis() - started;
+	running = 0;
+}
+
+void LinkTest_t::Service(void)
+{
+	if (!running) return;
+	if ((uint32_t)(millis() - lastSent) < interval) return;
+
+	// Don't queue up behind a frame in progress, try again next time
+	if (!MRF49XA.IsIdle()) return;
+
+	lastSent = millis();
+
+	MRF49XA.PacketGenerator(size, type, sequence++);
+	stats.sent++;
+}
+
+uint8_t LinkTest_t::PacketReceived(MRF_packet_t *packet)
+{
+	uint8_t kind = packet->type & PACKET_TYPE_MASK;
+
+	if (kind != PACKET_TYPE_TEST && kind != PACKET_TYPE_TEST_ECC) return 0;
+	if (packet->payloadSize < LINKTEST_HEADER_LEN) return 0;
+	if (packet->payload[LINKTEST_OFFSET_KIND] != LINKTEST_ECHO) return 0;
+
+	uint16_t echoed = packet->payload[LINKTEST_OFFSET_SEQUENCE] | 
+		(packet->payload[LINKTEST_OFFSET_SEQUENCE + 1] << 8);
+
+	// Sequence numbers wrap, compare them by their difference
+	if ((int16_t)(echoed - expected) < 0)
+	{
+		stats.duplicates++;
+		return 1;
+	}
+
+	expected = echoed + 1;
+
+	uint32_t sent = 0;
+
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sent |= (uint32_t)packet->payload[LINKTEST_OFFSET_TIME + i] << (8 * i);
+	}
+
+	// Up to the echo's sync word, so the time the frame waited for loop()
+	// doesn't count
+	MRF_frame_info_t info = MRF49XA.GetFrameInfo();
+	uint32_t rtt = info.timestamp - sent;
+
+	if (rtt < stats.rttMin) stats.rttMin = rtt;
+	if (rtt > stats.rttMax) stats.rttMax = rtt;
+
+	rtt >>= LINKTEST_RTT_SHIFT;
+	samples[sampleIndex] = (rtt > 0xFFFF) ? 0xFFFF : rtt;
+	sampleIndex = (sampleIndex + 1) % LINKTEST_SAMPLES;
+	if (sampleCount < LINKTEST_SAMPLES) sampleCount++;
+
+	stats.received++;
+	stats.bytes += packet->payloadSize;
+	stats.corrections += info.corrections;
+
+	return 1;
+}
+
+MRF_link_stats_t LinkTest_t::GetStats(void)
+{
+	if (running) stats.elapsed = millis() - started;
+
+	return stats;
+}
+
+// Sorts a copy of the recent samples, there are few enough of them
+uint32_t LinkTest_t::Percentile(uint8_t percent)
+{
+	uint16_t sorted[LINKTEST_SAMPLES];
+
+	if (sampleCount == 0) return 0;
+
+	for (uint8_t i = 0; i < sampleCount; i++)
+	{
+		uint16_t value = samples[i];
+		uint8_t j = i;
+
+		for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+
+		sorted[j] = value;
+	}
+
+	uint8_t index = ((uint16_t)percent * (sampleCount - 1) + 50) / 100;
+
+	return (uint32_t)sorted[index] << LINKTEST_RTT_SHIFT;
+}
+
+const char sentString[]        PROGMEM = "\n\rSent:        ";
+const char receivedString[]    PROGMEM = "\n\rReceived:    ";
+const char perString[]         PROGMEM = "\n\rPER (ppm):   ";
+const char goodputString[]     PROGMEM = "\n\rGoodput bps: ";
+const char rttString[]         PROGMEM = "\n\rRTT us min/50/90/99/max: ";
+const char correctionsString[] PROGMEM = "\n\rCorrections: ";
+const char duplicatesString[]  PROGMEM = "\n\rDuplicates:  ";
+
+void LinkTest_t::Report(Print &out)
+{
+	MRF_link_stats_t current = GetStats();
+
+	// Requests still in flight count as lost.  Both products overflow 32
+	// bits on long runs, so they're done in 64.
+	uint32_t per = 0;
+	if (current.sent) per = (uint64_t)(current.sent - current.received) * 1000000UL / current.sent;
+
+	uint32_t goodput = 0;
+	if (current.elapsed) goodput = (uint64_t)current.bytes * 8000UL / current.elapsed;
+
+	out.print(sentString);
+	out.print(current.sent, DEC);
+	out.print(receivedString);
+	out.print(current.received, DEC);
+	out.print(perString);
+	out.print(per, DEC);
+	out.print(goodputString);
+	out.print(goodput, DEC);
+	out.print(rttString);
+	out.print(current.received ? current.rttMin : 0, DEC);
+	out.print('/');
+	out.print(Percentile(50), DEC);
+	out.print('/');
+	out.print(Percentile(90), DEC);
+	out.print('/');
+	out.print(Percentile(99), DEC);
+	out.print('/');
+	out.print(current.rttMax, DEC);
+	out.print(correctionsString);
+	out.print(current.corrections, DEC);
+	out.print(duplicatesString);
+	out.print(current.duplicates, DEC);
+}
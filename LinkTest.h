@@ -0,0 +1,70 @@
+/*
+ *  LinkTest.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef LINKTEST_H
+#define LINKTEST_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Number of recent round trip times kept for the percentiles
+#define LINKTEST_SAMPLES     32
+
+// Round trip times are kept in units of 2^LINKTEST_RTT_SHIFT microseconds
+#define LINKTEST_RTT_SHIFT   6
+
+typedef struct {
+	uint32_t sent;				// Requests sent
+	uint32_t received;			// Echoes received
+	uint32_t duplicates;		// Echoes received twice or out of order
+	uint32_t bytes;				// Payload bytes in the echoes
+	uint32_t corrections;		// Hamming symbols corrected in the echoes
+	uint32_t rttMin;			// Microseconds
+	uint32_t rttMax;
+	uint32_t elapsed;			// Milliseconds since Start()
+} MRF_link_stats_t;
+
+// Measures a link against a node in reflect mode (MRF49XA.PacketReflect()).
+// Requests are sent at a fixed rate, and the echoes give the packet error
+// rate over the round trip, the goodput and the round trip time.
+class LinkTest_t
+{
+public:
+	// size is the payload size, type PACKET_TYPE_TEST or _TEST_ECC
+	void Start(uint8_t size, uint16_t interval, uint8_t type);
+	void Stop(void);
+
+	// Call from loop(), sends the next request when it's due
+	void Service(void);
+
+	// Hand every received packet to this.  Returns 1 if it was an echo
+	// and was consumed.
+	uint8_t PacketReceived(MRF_packet_t *packet);
+
+	MRF_link_stats_t GetStats(void);
+	uint32_t Percentile(uint8_t percent);	// Recent RTT in microseconds
+	void Report(Print &out);
+private:
+	MRF_link_stats_t stats;
+	uint16_t samples[LINKTEST_SAMPLES];
+	uint8_t sampleCount;
+	uint8_t sampleIndex;
+
+	uint8_t running;
+	uint8_t size;
+	uint8_t type;
+	uint16_t interval;
+	uint16_t sequence;			// Next request
+	uint16_t expected;			// Lowest sequence an echo may still have
+	uint32_t started;
+	uint32_t lastSent;
+};
+
+extern LinkTest_t LinkTest;
+
+#endif
@@ -14,421 +14,1770 @@
 #include "MRF49XA.h"
 #include "MRF49XA_definitions.h"
 #include "Hamming.h"
+#include "Trace.h"
+#include "Crypto.h"
+#include "Pool.h"
+
+#if defined(MRF_ISR_PROFILE) && defined(MRF_TRACE)
+#error "MRF_ISR_PROFILE and MRF_TRACE both use Timer 1"
+#endif
 
 MRF49XA_t MRF49XA = MRF49XA_t();
 
 static volatile uint8_t mrf_state;	// Defaults to idle
 static volatile uint8_t mrf_alive;	// Set to '1' by ISR
 
-volatile uint8_t packetCounter;
+volatile MRF_counter_t packetCounter;
+
+// Packet buffers come from the pool (see Pool.h).  The interrupt always
+// holds one to receive into, finished frames queue in rxReady until the
+// application takes them, and txHandle is the frame being sent.
+static MRF_handle_t rxHandle = MRF_HANDLE_NONE;
+static MRF_handle_t txHandle = MRF_HANDLE_NONE;
+static MRF_handle_t appHandle = MRF_HANDLE_NONE;	// Last one ReceivePacket() returned
 
-// There are 2 Rx_Packet_t instances, one for reading off the air
-// and one for processing back in main. (double buffering)
-MRF_packet_t Rx_Packet_a;
-MRF_packet_t Rx_Packet_b;
-MRF_packet_t Tx_packet;
+static MRF_handle_t rxReady[MRF_POOL_LEN];
+static volatile uint8_t rxReadyHead;
+static volatile uint8_t rxReadyCount;
 
-// The hasPacket flag means that the finished_packet variable contains
-// a fresh data packet.  The receiving_packet always contains space for
-// received data.  If finished_packet isn't read before the a second packet
-// comes the contents are lost
-volatile uint8_t	hasPacket;		// Initialized to 0 by default
-volatile MRF_packet_t *finished_packet;
 volatile MRF_packet_t *receiving_packet;
+MRF_packet_t *tx_packet;
 
 volatile uint16_t	mrf_status;
 
 static volatile uint8_t fiforstregUser;
 
+// Address filtering.  The node address defaults to broadcast, which
+// accepts every frame.  The sync byte must match SYNBREG on every node
+// of the network, so it is shadowed here for the transmitter.
+static volatile uint8_t nodeAddress = MRF_ADDRESS_BROADCAST;
+static volatile uint8_t syncByte    = 0xD4;
+
+// The FIFO interrupt runs the handler of the current phase of the frame.
+// The frame layout is worked out once, when the header is built or the
+// type byte arrives, and each phase hands over to the next when it ends.
+typedef void (*MRF_fifo_handler_t)(void);
+
+static void IdleISR(void);
+
+static volatile MRF_fifo_handler_t fifoHandler = IdleISR;
+static MRF_fifo_handler_t txPayloadHandler;
+static MRF_fifo_handler_t rxPayloadHandler;
+
+// The payload handlers come in one version for each combination of the
+// encrypted and whitened flags, see TxPayloadHandler()
+#define MRF_FLAGS_CODED		(PACKET_FLAG_ENCRYPTED | PACKET_FLAG_WHITENED)
+#define MRF_FLAGS_RUNTIME	0xFF
+
+#ifdef MRF_ISR_PROFILE
+static MRF_isr_profile_t isrProfile;
+static uint8_t txKind;
+static uint8_t rxKind;
+#endif
+
+// The packetCounter values where the payload starts and ends and where the
+// frame ends, and the type byte of the frames in progress
+static uint8_t txPayloadStart;
+static MRF_counter_t txPayloadEnd;
+static MRF_counter_t txFrameEnd;
+static uint8_t txFlags;
+static uint8_t rxPayloadStart;
+static MRF_counter_t rxPayloadEnd;
+static MRF_counter_t rxFrameEnd;
+static uint8_t rxFlags;
+
+// Sync word, size, type and the optional header fields of the frame being
+// sent, built once by StartTransmit()
+static uint8_t txHeader[4 + MRF_ADDRESS_OVERHEAD + MRF_RELAY_OVERHEAD + CRYPTO_NONCE_LEN];
+
+// Number of 0xAA preamble bytes sent after the 0xAAAA already in the TX
+// register, and the number still to send for the frame in progress.
+static volatile uint8_t txPreambleLength = 1;
+static uint8_t txPreambleCounter;
+
+// Whitening LFSR state for the frames in progress
+static uint16_t txWhitening;
+static uint16_t rxWhitening;
+
+// Link information for the frame being received, the queued ones and the
+// one the application took last
+static MRF_frame_info_t receivingInfo;
+static MRF_frame_info_t frameInfo[MRF_POOL_LEN];
+static MRF_frame_info_t finishedInfo;
+
+// When the sync word of the last frame went out
+static volatile uint32_t txTimestamp;
+
+// When set, link test requests are echoed from the ISR
+static volatile uint8_t reflect;
+
+// When set, ECC payloads are stored as received instead of decoded
+static volatile uint8_t rawReceive;
+static uint8_t rxRaw;
+
+// Event queue, written by the interrupt (or with interrupts held off) and
+// read by Dispatch().  Each side only moves its own index.
+typedef struct {
+	uint8_t event;
+	uint8_t data;
+} MRF_event_t;
+
+static MRF_event_t events[MRF_EVENT_QUEUE_LEN];
+static volatile uint8_t eventHead;
+static volatile uint8_t eventTail;
+static volatile uint8_t eventsLost;
+
+// Link errors of each class, indexed by the MRF_ERROR_* code
+static uint16_t errorCounts[MRF_ERROR_CLASSES];
+
+static MRF_receive_handler_t receiveHandler;
+static MRF_event_handler_t txDoneHandler;
+static MRF_event_handler_t txFailedHandler;
+static MRF_event_handler_t linkErrorHandler;
+
+// Set for frames the application asked for, echoes don't post TX_DONE
+static uint8_t txNotify;
+
+// Relaying.  The duplicate cache is direct mapped on a hash of the
+// (source, sequence) pair, relayCacheValid has a bit per slot.
+static volatile uint8_t repeater;
+static MRF_router_t router;
+static uint8_t relaySequence;
+static uint16_t relayCache[MRF_RELAY_CACHE_LEN];
+static uint8_t relayCacheValid;
+
+// Cipher state of the encrypted frames in progress.  The TX side keeps the
+// encrypted byte for the second Hamming symbol, the RX side collects the
+// differences between the received and the computed tag.
+static MRF_cipher_t txCipher;
+static MRF_cipher_t rxCipher;
+static uint8_t txCipherByte;
+static uint8_t rxTagError;
+
+// Streaming receive.  The sequence counts headers, streamAvailable is the
+// number of payload bytes of that frame written so far.
+static volatile MRF_packet_t *streamPacket;
+static volatile MRF_handle_t streamHandle;
+static volatile uint8_t streamSequence;
+static volatile uint8_t streamAvailable;
+static volatile uint8_t streamState;
+
+// Every command is a 16 bit frame, most significant byte first, and is
+// latched by the transceiver on the rising edge of chip select.
+static inline void Select(void)
+{
+	MRF_CS_PORTx &= ~(1 << MRF_CS_BIT);
+}
+
+static inline void Deselect(void)
+{
+	MRF_CS_PORTx |=  (1 << MRF_CS_BIT);
+}
+
 void RegisterSet(uint16_t setting)
 {
+	Select();
+	SPI.transfer((uint8_t)(setting >> 8));
 	SPI.transfer((uint8_t)(setting & 0x00FF));
-	SPI.transfer((uint8_t)(setting & 0xFF00) >> 8);
+	Deselect();
 }
 
+// The FIFO data is clocked out during the second byte of the read command
 static inline uint8_t ReadFifo(void)
 {
-	RegisterSet(MRF_RXFIFOREG);
-	return SPI.transfer(0xFF);
+	uint8_t data;
+
+	Select();
+	SPI.transfer((uint8_t)(MRF_RXFIFOREG >> 8));
+	data = SPI.transfer(0x00);
+	Deselect();
+
+	return data;
+}
+
+static inline uint16_t StatusRead(void)
+{
+	uint16_t retval = 0x0000;
+
+	Select();
+	retval |= SPI.transfer(0x00) << 8;
+	retval |= SPI.transfer(0x00);
+	Deselect();
+
+	return retval;
+}
+
+// With chip select low, SDO mirrors the FIFO interrupt flag
+static inline uint8_t FifoReady(void)
+{
+	uint8_t ready;
+
+	Select();
+	ready = digitalRead(MISO);
+	Deselect();
+
+	return ready;
+}
+
+static void PostEvent(uint8_t event, uint8_t data)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	uint8_t next = (eventHead + 1) & (MRF_EVENT_QUEUE_LEN - 1);
+
+	if (next == eventTail) 
+	{
+		if (eventsLost != 0xFF) eventsLost++;
+	}
+	else 
+	{
+		events[eventHead].event = event;
+		events[eventHead].data  = data;
+		eventHead = next;
+	}
+
+	SREG = sreg;
+}
+
+// Counts a link error and tells the application about it
+static void LinkError(uint8_t error)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	if (errorCounts[error] != 0xFFFF) errorCounts[error]++;
+
+	SREG = sreg;
+
+	PostEvent(MRF_EVENT_LINK_ERROR, error);
+}
+
+// The optional header fields, in the order they follow the type byte
+static inline uint8_t HeaderLength(uint8_t type)
+{
+    uint8_t length = 0;
+
+    if (type & PACKET_FLAG_ADDRESSED) length += MRF_ADDRESS_OVERHEAD;
+    if (type & PACKET_FLAG_RELAY) length += MRF_RELAY_OVERHEAD;
+    if (type & PACKET_FLAG_ENCRYPTED) length += CRYPTO_NONCE_LEN;
+
+    return length;
+}
+
+static inline volatile uint8_t *HeaderField(volatile MRF_packet_t *packet, uint8_t index)
+{
+    if (packet->type & PACKET_FLAG_ADDRESSED) 
+    {
+        if (index == 0) return &packet->address;
+        index--;
+    }
+
+    if (packet->type & PACKET_FLAG_RELAY) 
+    {
+        switch (index) 
+        {
+            case RELAY_OFFSET_SOURCE:   return &packet->source;
+            case RELAY_OFFSET_TARGET:   return &packet->target;
+            case RELAY_OFFSET_SEQUENCE: return &packet->sequence;
+            case RELAY_OFFSET_HOPS:     return &packet->hops;
+        }
+
+        index -= MRF_RELAY_OVERHEAD;
+    }
+
+    return &packet->nonce[index];
+}
+
+static void CopyPacket(volatile MRF_packet_t *to, volatile MRF_packet_t *from)
+{
+    to->payloadSize = from->payloadSize;
+    to->type        = from->type;
+    to->address     = from->address;
+    to->source      = from->source;
+    to->target      = from->target;
+    to->sequence    = from->sequence;
+    to->hops        = from->hops;
+
+    for (uint8_t i = 0; i < CRYPTO_NONCE_LEN; i++) to->nonce[i] = from->nonce[i];
+
+    for (uint8_t i = 0; i < from->payloadSize; i++) to->payload[i] = from->payload[i];
+}
+
+// Returns 1 if the frame was seen before, otherwise remembers it
+static uint8_t RelaySeen(uint8_t source, uint8_t sequence)
+{
+    uint16_t key = ((uint16_t)source << 8) | sequence;
+    uint8_t slot = (source ^ sequence ^ (sequence >> 3)) & (MRF_RELAY_CACHE_LEN - 1);
+
+    if ((relayCacheValid & (1 << slot)) && relayCache[slot] == key) return 1;
+
+    relayCache[slot] = key;
+    relayCacheValid |= 1 << slot;
+
+    return 0;
+}
+
+// The header is complete, the application may start following the frame
+static inline void StreamStart(void)
+{
+    streamPacket = receiving_packet;
+    streamHandle = rxHandle;
+    streamAvailable = 0;
+    streamState = MRF_STREAM_ACTIVE;
+    streamSequence++;
+}
+
+// Handlers are switched from the interrupt and from loop(), the pointer
+// takes two writes on AVR, so keep the interrupt out while it changes
+static inline void SetHandler(MRF_fifo_handler_t handler)
+{
+    uint8_t sreg = SREG;
+    cli();
+    fifoHandler = handler;
+    SREG = sreg;
+}
+
+// Power management.  Every PMCREG write goes through here, with the chains
+// that should run, so the other bits stay the same in every state.
+static uint8_t powerState = MRF_POWER_ON;
+static uint32_t wakeStart;
+static uint16_t wakeLatency;
+
+static inline void PowerSet(uint16_t chains)
+{
+    RegisterSet(MRF_PMCREG_SET | chains);
+}
+
+// The chains were just turned back on, sending waits until they've settled
+static inline void StartWake(void)
+{
+    wakeStart = micros();
+    wakeLatency = (powerState == MRF_POWER_SLEEP) ? MRF_WAKE_SLEEP_US : MRF_WAKE_STANDBY_US;
+    powerState = MRF_POWER_ON;
+}
+
+// Drop the frame in progress and wait for the next sync word
+static inline void RestartSync(void)
+{
+    if (streamState == MRF_STREAM_ACTIVE) streamState = MRF_STREAM_ABORT;
+
+    RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
+    RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser | MRF_FSCF);
+
+    mrf_state = MRF_IDLE;
+    packetCounter = 0;
+    SetHandler(IdleISR);
+}
+
+// PN9 whitening sequence (x^9 + x^5 + 1), restarted for every frame.
+// Whitening breaks up long runs of identical bits in the payload so clock
+// recovery stays locked, it costs one 8-step shift per byte.
+static inline uint8_t WhitenNext(uint16_t &state)
+{
+    uint8_t out = state & 0xFF;
+
+    for (uint8_t i = 0; i < 8; i++) 
+    {
+        state = (state >> 1) | (((state ^ (state >> 5)) & 0x01) << 8);
+    }
+
+    return out;
+}
+
+/*******************************************************************************
+ * Transmit phases: preamble, header (sync word, size, type and the optional
+ * fields), payload, trailer (tag and dummy byte).  StartTransmit() works out
+ * where each phase ends and builds the header, so every FIFO interrupt is
+ * one indirect call to a handler that only does its own byte.
+ ******************************************************************************/
+static void TxHeaderISR(void);
+static void TxTrailerISR(void);
+
+// The transmitter takes over the buffer, nothing is copied
+static inline void TakeTransmitter(MRF_handle_t handle)
+{
+    Pool.Give(handle, MRF_OWNER_TX);
+    txHandle  = handle;
+    tx_packet = Pool.Get(handle);
+}
+
+// Returns the buffer of the frame that was sent (or abandoned) to the pool
+static inline void ReleaseTransmitter(void)
+{
+    Pool.Free(txHandle);
+    txHandle = MRF_HANDLE_NONE;
+}
+
+static void TxEndISR(void)
+{
+    // Disable transmitter, enable receiver
+    PowerSet(MRF_RXCEN);
+    RegisterSet(MRF_GENCREG_SET | MRF_FIFOEN);
+    RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
+    RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser | MRF_FSCF);
+    
+    MRF_TRACE_EVENT(MRF_TRACE_TX_END, tx_packet->type);
+
+    // The flag was cleared when the frame started, so it's set only if a
+    // byte was written too late and the frame went out corrupted
+    if (StatusRead() & MRF_TXOWRXOF) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_UNDERRUN, tx_packet->type);
+        LinkError(MRF_ERROR_UNDERRUN);
+
+        if (txNotify) PostEvent(MRF_EVENT_TX_FAILED, tx_packet->type);
+    }
+    else if (txNotify) PostEvent(MRF_EVENT_TX_DONE, tx_packet->type);
+
+    ReleaseTransmitter();
+
+    // Return the state
+    mrf_state = MRF_IDLE;
+    packetCounter = 0;
+    fifoHandler = IdleISR;
+}
+
+// The preamble isn't counted, packetCounter starts at the sync word
+static void TxPreambleISR(void)
+{
+    RegisterSet(MRF_TXBREG | 0x00AA);
+
+    if (--txPreambleCounter == 0) fifoHandler = TxHeaderISR;
+}
+
+// Time sync frames get the time in the payload, it hasn't been read yet.
+// Only our own: a forwarded frame carries its origin's time, and its
+// payload may already be encrypted under the origin's nonce.
+static inline void StampTransmit(void)
+{
+    uint32_t now = micros();
+    uint8_t kind = tx_packet->type & PACKET_TYPE_MASK;
+
+    txTimestamp = now;
+
+    if (!txNotify) return;
+    if (kind != PACKET_TYPE_TIME && kind != PACKET_TYPE_TIME_ECC) return;
+    if (tx_packet->payloadSize < TIMESYNC_OFFSET_SENT + 4) return;
+
+    for (uint8_t i = 0; i < 4; i++) tx_packet->payload[TIMESYNC_OFFSET_SENT + i] = now >> (8 * i);
+}
+
+static void TxHeaderISR(void)
+{
+    if (packetCounter == 0) StampTransmit();
+
+    RegisterSet(MRF_TXBREG | txHeader[packetCounter]);
+
+    if (++packetCounter == txPayloadStart) fifoHandler = txPayloadHandler;
+}
+
+// Whitening is applied to the coded bytes, as they go on the air.  flags
+// are the frame's encrypted and whitened flags, fixed when the frame
+// starts so the tests fold away, or MRF_FLAGS_RUNTIME to test txFlags.
+template <uint8_t ecc, uint8_t flags>
+static void TxPayloadISR(void)
+{
+    MRF_counter_t offset = packetCounter - txPayloadStart;
+    uint8_t frame = (flags == MRF_FLAGS_RUNTIME) ? txFlags : flags;
+    uint8_t data;
+
+    // In ECC mode every payload byte is sent as two Hamming coded
+    // symbols, the low nibble first
+    if (ecc) 
+    {
+        if (offset & 0x01) 
+        {
+            data = Hamming.EncodeNibble(txCipherByte >> 4);
+        }
+        else 
+        {
+            txCipherByte = tx_packet->payload[offset >> 1];
+
+            if (frame & PACKET_FLAG_ENCRYPTED) txCipherByte = Crypto.Encrypt(&txCipher, txCipherByte);
+
+            data = Hamming.EncodeNibble(txCipherByte & 0x0F);
+        }
+    }
+    else 
+    {
+        data = tx_packet->payload[offset];
+
+        if (frame & PACKET_FLAG_ENCRYPTED) data = Crypto.Encrypt(&txCipher, data);
+    }
+
+    if (frame & PACKET_FLAG_WHITENED) data ^= WhitenNext(txWhitening);
+
+    RegisterSet(MRF_TXBREG | data);
+
+    if (++packetCounter == txPayloadEnd) fifoHandler = TxTrailerISR;
+}
+
+// Picks the payload handler for a frame's type byte
+template <uint8_t ecc>
+static MRF_fifo_handler_t TxPayloadHandler(uint8_t type)
+{
+#ifdef MRF_ISR_GENERIC
+    return TxPayloadISR<ecc, MRF_FLAGS_RUNTIME>;
+#else
+    switch (type & MRF_FLAGS_CODED) 
+    {
+        case 0:                     return TxPayloadISR<ecc, 0>;
+        case PACKET_FLAG_ENCRYPTED: return TxPayloadISR<ecc, PACKET_FLAG_ENCRYPTED>;
+        case PACKET_FLAG_WHITENED:  return TxPayloadISR<ecc, PACKET_FLAG_WHITENED>;
+        default:                    return TxPayloadISR<ecc, MRF_FLAGS_CODED>;
+    }
+#endif
+}
+
+// The tag of encrypted frames and one dummy byte follow the payload
+static void TxTrailerISR(void)
+{
+    MRF_counter_t index = packetCounter - txPayloadEnd;
+    uint8_t data = 0xAA;
+
+    if (txFlags & PACKET_FLAG_ENCRYPTED) 
+    {
+        if (index == 0) Crypto.Finish(&txCipher);
+        if (index < CRYPTO_TAG_LEN) data = txCipher.mac[index];
+    }
+
+    RegisterSet(MRF_TXBREG | data);
+
+    if (++packetCounter == txFrameEnd) fifoHandler = TxEndISR;
+}
+
+// Starts sending tx_packet, mrf_state must already be MRF_TRANSMIT_PACKET
+static void StartTransmit(void)
+{
+    uint8_t type = tx_packet->type & PACKET_TYPE_MASK;
+    uint8_t fields = HeaderLength(tx_packet->type);
+
+	// Initialize the constant parts of the transmit buffer
+	packetCounter = 0;
+
+    txHeader[0] = 0x2D;
+    txHeader[1] = syncByte;
+    txHeader[2] = tx_packet->payloadSize;
+    txHeader[3] = tx_packet->type;
+
+    for (uint8_t i = 0; i < fields; i++) txHeader[4 + i] = *HeaderField(tx_packet, i);
+
+    // ECC payloads are twice as large as advertised
+    txFlags = tx_packet->type;
+    txPayloadStart = 4 + fields;
+    txPayloadEnd = txPayloadStart + tx_packet->payloadSize;
+    if (PACKET_TYPE_IS_ECC(type)) txPayloadEnd += tx_packet->payloadSize;
+
+    txFrameEnd = txPayloadEnd + 1;
+    if (txFlags & PACKET_FLAG_ENCRYPTED) txFrameEnd += CRYPTO_TAG_LEN;
+
+#ifdef MRF_ISR_PROFILE
+    txKind = MRF_ISR_KIND(txFlags);
+#endif
+
+    if (PACKET_TYPE_IS_ECC(type)) txPayloadHandler = TxPayloadHandler<1>(txFlags);
+    else txPayloadHandler = TxPayloadHandler<0>(txFlags);
+
+    // An empty payload goes straight to the trailer
+    if (txPayloadEnd == txPayloadStart) txPayloadHandler = TxTrailerISR;
+
+    txPreambleCounter = txPreambleLength;
+    txWhitening = MRF_WHITENING_SEED;
+
+    if (txFlags & PACKET_FLAG_ENCRYPTED) 
+    {
+        Crypto.Start(&txCipher, tx_packet->nonce, tx_packet->type, tx_packet->payloadSize);
+    }
+
+    SetHandler(txPreambleCounter ? TxPreambleISR : TxHeaderISR);
+
+    MRF_TRACE_EVENT(MRF_TRACE_TX_START, tx_packet->type);
+
+	PowerSet(MRF_OSCEN);						// Everything off but the crystal
+	StatusRead();								// Clear the underrun flag
+	RegisterSet(MRF_GENCREG_SET | MRF_TXDEN);	// Enable TX FIFO
+	// Reset value of TX FIFO is 0xAAAA
+	
+	PowerSet(MRF_TXCEN);						// Begin transmitting
+	// Everything else is handled in the ISR
+}
+
+// Link test requests are echoed straight from the receive interrupt, so
+// the measured round trip doesn't include the application's loop time.
+static inline uint8_t Reflectable(volatile MRF_packet_t *packet)
+{
+    uint8_t type = packet->type & PACKET_TYPE_MASK;
+
+    if (type != PACKET_TYPE_TEST && type != PACKET_TYPE_TEST_ECC) return 0;
+    if (packet->payloadSize < LINKTEST_HEADER_LEN) return 0;
+    if (packet->payload[LINKTEST_OFFSET_KIND] != LINKTEST_REQUEST) return 0;
+
+    // The echo differs from the request, it can't reuse the nonce
+    if (packet->type & PACKET_FLAG_ENCRYPTED) return 0;
+
+    return 1;
+}
+
+// The request's buffer is sent back as the echo
+static inline void ReflectISR(MRF_handle_t handle)
+{
+    TakeTransmitter(handle);
+
+    tx_packet->payload[LINKTEST_OFFSET_KIND] = LINKTEST_ECHO;
+
+    txNotify = 0;
+    mrf_state = MRF_TRANSMIT_PACKET;
+    StartTransmit();
+}
+
+// Relayed frames are forwarded unless their TTL is used up, or this node
+// is their source or target.
+static inline uint8_t Forwardable(volatile MRF_packet_t *packet)
+{
+    if (RELAY_TTL(packet->hops) == 0) return 0;
+
+    return packet->source != nodeAddress && packet->target != nodeAddress;
+}
+
+// Sends a relayed frame on with one more hop taken
+static inline void ForwardISR(MRF_handle_t handle)
+{
+    TakeTransmitter(handle);
+
+    uint8_t ttl  = RELAY_TTL(tx_packet->hops);
+    uint8_t hops = RELAY_HOPS(tx_packet->hops);
+
+    if (hops < 0x0F) hops++;
+    tx_packet->hops = RELAY_HOPS_TTL(hops, ttl - 1);
+
+    // Routed frames go to the next hop only, the others are flooded
+    uint8_t nextHop = MRF_ADDRESS_BROADCAST;
+    if (router) nextHop = router(tx_packet->target);
+
+    if (nextHop != MRF_ADDRESS_BROADCAST) tx_packet->type |= PACKET_FLAG_ADDRESSED;
+    tx_packet->address = nextHop;
+
+    MRF_TRACE_EVENT(MRF_TRACE_FORWARD, tx_packet->hops);
+
+    txNotify = 0;
+    mrf_state = MRF_TRANSMIT_PACKET;
+    StartTransmit();
 }
 
-static inline void IdleISR(void)
+/*******************************************************************************
+ * Receive phases: length (IdleISR), type, optional header fields, payload
+ * and tag.  The frame layout is known once the type byte is in, so that's
+ * where the phase boundaries and the payload handler are worked out.
+ ******************************************************************************/
+static void RxTypeISR(void);
+static void RxHeaderISR(void);
+static void RxTagISR(void);
+
+static void IdleISR(void)
 {
+    uint32_t now = micros();
     uint8_t bl = ReadFifo();
 
+    MRF_TRACE_DATA(bl);
+
     // The first byte is the packet payload length, make sure it's sensical
     if (bl <= MRF_PAYLOAD_LEN && bl > 0) 
     {
         mrf_state  = MRF_RECEIVE_PACKET;
+        fifoHandler = RxTypeISR;
 
         receiving_packet->payloadSize = bl;
-        
-        for (int i = 0; i < bl; i++) receiving_packet->payload[i] = 0;   // Clean the previous payload
+
+        // RSSI, data quality and clock lock are valid while the frame is on air
+        receivingInfo.status = StatusRead();
+        receivingInfo.flags  = 0;
+        receivingInfo.corrections = 0;
+        receivingInfo.timestamp = now;
         
         // We've received 1 byte
         packetCounter = 1;
+
+        MRF_TRACE_EVENT(MRF_TRACE_SYNC, bl);
     }
-    // The length doesn't make sense, so reset
+    // The length doesn't make sense, the sync word was a false match.
+    // Re-arming the sync latch is enough, the receiver keeps running.
     else 
     {
-        packetCounter = 0;
-        MRF49XA.Reset();
+        MRF_TRACE_EVENT(MRF_TRACE_LENGTH_REJECT, bl);
+        LinkError(MRF_ERROR_LENGTH);
+
+        RestartSync();
         return;
     }
 }
 
-static inline void TransmitISR(void)
+// The header is complete: start the cipher and let the application follow
+static void RxPayloadStart(void)
+{
+    if (rxFlags & PACKET_FLAG_ENCRYPTED) 
+    {
+        Crypto.Start(&rxCipher, receiving_packet->nonce, receiving_packet->type, receiving_packet->payloadSize);
+    }
+
+    StreamStart();
+
+    fifoHandler = rxPayloadHandler;
+}
+
+static void RxFinish(void);
+
+// See TxPayloadISR() for flags
+template <uint8_t ecc, uint8_t flags>
+static void RxPayloadISR(void)
+{
+	uint8_t bl = ReadFifo();
+    MRF_counter_t offset = packetCounter - rxPayloadStart;
+    uint8_t frame = (flags == MRF_FLAGS_RUNTIME) ? rxFlags : flags;
+
+    MRF_TRACE_DATA(bl);
+
+    // Undo the whitening before decoding
+    if (frame & PACKET_FLAG_WHITENED) bl ^= WhitenNext(rxWhitening);
+
+    if (ecc) 
+    {
+        // The high nibble of the check value is the syndrome
+        uint8_t nibble = Hamming.CheckNibble(bl);
+        uint8_t index = offset >> 1;
+
+        if ((nibble & 0xF0) && receivingInfo.corrections != 0xFF) receivingInfo.corrections++;
+
+        // If the offset is odd, we're recieving the high nibble.
+        // The low nibble arrived first, so we can just or-in the new info
+        if (offset & 0x01) 
+        {
+            uint8_t data = receiving_packet->payload[index] | (nibble << 4);
+
+            if (frame & PACKET_FLAG_ENCRYPTED) data = Crypto.Decrypt(&rxCipher, data);
+
+            receiving_packet->payload[index] = data;
+            streamAvailable++;
+        }
+        // Otherwise, we're receiving the low nibble
+        else 
+        {
+            receiving_packet->payload[index] = nibble & 0x0F;
+        }
+    }
+    else 
+    {
+        if (frame & PACKET_FLAG_ENCRYPTED) bl = Crypto.Decrypt(&rxCipher, bl);
+
+        receiving_packet->payload[offset] = bl;
+        streamAvailable++;
+    }
+
+    if (++packetCounter < rxPayloadEnd) return;
+
+    if (frame & PACKET_FLAG_ENCRYPTED) fifoHandler = RxTagISR;
+    else RxFinish();
+}
+
+template <uint8_t ecc>
+static MRF_fifo_handler_t RxPayloadHandler(uint8_t type)
+{
+#ifdef MRF_ISR_GENERIC
+    return RxPayloadISR<ecc, MRF_FLAGS_RUNTIME>;
+#else
+    switch (type & MRF_FLAGS_CODED) 
+    {
+        case 0:                     return RxPayloadISR<ecc, 0>;
+        case PACKET_FLAG_ENCRYPTED: return RxPayloadISR<ecc, PACKET_FLAG_ENCRYPTED>;
+        case PACKET_FLAG_WHITENED:  return RxPayloadISR<ecc, PACKET_FLAG_WHITENED>;
+        default:                    return RxPayloadISR<ecc, MRF_FLAGS_CODED>;
+    }
+#endif
+}
+
+// Raw symbols are stored in the order they arrived
+template <uint8_t flags>
+static void RxRawISR(void)
+{
+	uint8_t bl = ReadFifo();
+    uint8_t frame = (flags == MRF_FLAGS_RUNTIME) ? rxFlags : flags;
+
+    MRF_TRACE_DATA(bl);
+
+    if (frame & PACKET_FLAG_WHITENED) bl ^= WhitenNext(rxWhitening);
+
+    receiving_packet->payload[packetCounter - rxPayloadStart] = bl;
+    streamAvailable++;
+
+    if (++packetCounter == rxPayloadEnd) RxFinish();
+}
+
+// Raw frames are never encrypted
+static MRF_fifo_handler_t RxRawHandler(uint8_t type)
+{
+#ifdef MRF_ISR_GENERIC
+    return RxRawISR<MRF_FLAGS_RUNTIME>;
+#else
+    if (type & PACKET_FLAG_WHITENED) return RxRawISR<PACKET_FLAG_WHITENED>;
+    return RxRawISR<0>;
+#endif
+}
+
+// The tag of encrypted frames isn't coded or whitened
+static void RxTagISR(void)
+{
+	uint8_t bl = ReadFifo();
+
+    MRF_TRACE_DATA(bl);
+
+    if (packetCounter == rxPayloadEnd) Crypto.Finish(&rxCipher);
+
+    rxTagError |= bl ^ rxCipher.mac[packetCounter - rxPayloadEnd];
+
+    if (++packetCounter == rxFrameEnd) RxFinish();
+}
+
+// We've received the payload length, this is the type field
+static void RxTypeISR(void)
+{
+	uint8_t bl = ReadFifo();
+    uint8_t type = bl & PACKET_TYPE_MASK;
+
+    MRF_TRACE_DATA(bl);
+
+    // No frame has type 0, the sync word was found in noise and the length
+    // happened to pass
+    if (type == 0) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_LOST_SYNC, bl);
+        LinkError(MRF_ERROR_SYNC);
+
+        RestartSync();
+        return;
+    }
+
+    receiving_packet->type = bl;
+    rxFlags = bl;
+    rxWhitening = MRF_WHITENING_SEED;
+    rxTagError = 0;
+
+    if (!(bl & PACKET_FLAG_ADDRESSED)) receiving_packet->address = MRF_ADDRESS_BROADCAST;
+
+    // Encrypted frames can't be checked without the key, and raw
+    // symbols can't be decrypted
+    if ((bl & PACKET_FLAG_ENCRYPTED) && (!Crypto.HasKey() || rawReceive)) 
+    {
+        RestartSync();
+        return;
+    }
+
+    // Raw ECC payloads take twice the space, drop the ones that don't fit
+    rxRaw = rawReceive && PACKET_TYPE_IS_ECC(type);
+
+    if (rxRaw)
+    {
+        if (receiving_packet->payloadSize > MRF_PAYLOAD_LEN / 2) 
+        {
+            RestartSync();
+            return;
+        }
+
+        receivingInfo.flags |= MRF_INFO_RAW;
+    }
+
+    // ECC payloads are twice as large as advertised
+    rxPayloadStart = MRF_PACKET_OVERHEAD + HeaderLength(bl);
+    rxPayloadEnd = rxPayloadStart + receiving_packet->payloadSize;
+    if (PACKET_TYPE_IS_ECC(type)) rxPayloadEnd += receiving_packet->payloadSize;
+
+    rxFrameEnd = rxPayloadEnd;
+    if (bl & PACKET_FLAG_ENCRYPTED) rxFrameEnd += CRYPTO_TAG_LEN;
+
+#ifdef MRF_ISR_PROFILE
+    rxKind = MRF_ISR_KIND(bl);
+#endif
+
+    if (rxRaw) rxPayloadHandler = RxRawHandler(bl);
+    else if (PACKET_TYPE_IS_ECC(type)) rxPayloadHandler = RxPayloadHandler<1>(bl);
+    else rxPayloadHandler = RxPayloadHandler<0>(bl);
+
+    packetCounter++;
+
+    if (packetCounter == rxPayloadStart) RxPayloadStart();
+    else fifoHandler = RxHeaderISR;
+}
+
+// The address, relay header and nonce
+static void RxHeaderISR(void)
+{
+	uint8_t bl = ReadFifo();
+    uint8_t field = packetCounter - MRF_PACKET_OVERHEAD;
+
+    MRF_TRACE_DATA(bl);
+
+    // If it's the address field, drop frames for other nodes right
+    // away rather than clocking in the whole payload.
+    if (field == 0 && (rxFlags & PACKET_FLAG_ADDRESSED) &&
+        nodeAddress != MRF_ADDRESS_BROADCAST && 
+        bl != nodeAddress && bl != MRF_ADDRESS_BROADCAST)
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_ADDRESS_DROP, bl);
+        RestartSync();
+        return;
+    }
+
+    *HeaderField(receiving_packet, field) = bl;
+
+    if (++packetCounter == rxPayloadStart) RxPayloadStart();
+}
+
+// Swaps a fresh buffer in for the next frame and returns the finished
+// one.  One buffer is always left for the transmitter; with nothing to
+// swap in, the finished frame is dropped and its buffer received into
+// again.
+static MRF_handle_t TakeReceived(void)
+{
+    MRF_handle_t finished = rxHandle;
+    MRF_handle_t next = Pool.Allocate(MRF_OWNER_RX, txHandle == MRF_HANDLE_NONE);
+
+    if (next == MRF_HANDLE_NONE) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_OVERRUN, receiving_packet->type);
+        LinkError(MRF_ERROR_OVERRUN);
+        return MRF_HANDLE_NONE;
+    }
+
+    rxHandle = next;
+    receiving_packet = Pool.Get(next);
+    receiving_packet->payloadSize = 0;
+
+    return finished;
+}
+
+// The whole frame is in
+static void RxFinish(void)
+{
+    MRF_handle_t handle;
+
+    // The overflow flag was cleared by the status read at the length byte,
+    // if it's set again bytes were lost somewhere in this frame
+    if (StatusRead() & MRF_TXOWRXOF) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_FIFO_OVERFLOW, receiving_packet->type);
+        LinkError(MRF_ERROR_FIFO);
+
+        streamState = MRF_STREAM_ABORT;
+        RestartSync();
+        return;
+    }
+
+    // Frames that fail authentication are dropped
+    if ((rxFlags & PACKET_FLAG_ENCRYPTED) && rxTagError) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_AUTH_FAIL, receiving_packet->type);
+        LinkError(MRF_ERROR_AUTH);
+
+        streamState = MRF_STREAM_ABORT;
+        RestartSync();
+        return;
+    }
+
+    // Reset the FIFO and restore state.  The stream commits only once the
+    // frame is queued below, every other way out drops it.
+    streamState = MRF_STREAM_DROPPED;
+    RestartSync();
+
+    // Echo link test requests without handing them to the application
+    if (reflect && !rxRaw && Reflectable(receiving_packet)) 
+    {
+        MRF_TRACE_EVENT(MRF_TRACE_REFLECT, receiving_packet->type);
+
+        handle = TakeReceived();
+        if (handle != MRF_HANDLE_NONE) ReflectISR(handle);
+        return;
+    }
+
+    if (rxFlags & PACKET_FLAG_RELAY) 
+    {
+        if (RelaySeen(receiving_packet->source, receiving_packet->sequence)) 
+        {
+            MRF_TRACE_EVENT(MRF_TRACE_DUPLICATE, receiving_packet->source);
+            return;
+        }
+
+        // Only hand over frames meant for this node
+        uint8_t local = nodeAddress == MRF_ADDRESS_BROADCAST ||
+                        receiving_packet->target == nodeAddress ||
+                        receiving_packet->target == MRF_ADDRESS_BROADCAST;
+
+        // Frames that are only passing through go out in their own buffer,
+        // the ones also delivered here are forwarded from a copy
+        if (repeater && !rxRaw && Forwardable(receiving_packet)) 
+        {
+            if (!local) 
+            {
+                handle = TakeReceived();
+                if (handle != MRF_HANDLE_NONE) ForwardISR(handle);
+                return;
+            }
+
+            handle = Pool.Allocate(MRF_OWNER_TX, 0);
+
+            if (handle != MRF_HANDLE_NONE) 
+            {
+                CopyPacket(Pool.Get(handle), receiving_packet);
+                ForwardISR(handle);
+            }
+        }
+
+        if (!local) return;
+    }
+
+    handle = TakeReceived();
+    if (handle == MRF_HANDLE_NONE) return;
+
+    MRF_TRACE_EVENT(MRF_TRACE_FRAME_DONE, Pool.Get(handle)->type);
+
+    // Queue it for the application, the queue holds every buffer there is
+    uint8_t slot = rxReadyHead + rxReadyCount;
+    if (slot >= MRF_POOL_LEN) slot -= MRF_POOL_LEN;
+
+    rxReady[slot] = handle;
+    frameInfo[handle] = receivingInfo;
+    rxReadyCount++;
+    streamState = MRF_STREAM_COMMIT;
+
+    PostEvent(MRF_EVENT_RECEIVED, Pool.Get(handle)->type);
+}
+
+// Spectrum tests, mrf_state selects the pattern
+static void TestPatternISR(void)
+{
+	switch (mrf_state) 
+	{
+		case MRF_TRANSMIT_ZERO:
+			RegisterSet(MRF_TXBREG | 0x0000);
+			break;
+			
+		case MRF_TRANSMIT_ONE:
+			RegisterSet(MRF_TXBREG | 0x00FF);
+			break;
+			
+		default:
+			RegisterSet(MRF_TXBREG | 0x00AA);
+			break;
+	}
+}
+
+// The transmitter is claimed but the frame isn't set up yet.  Bytes the
+// receiver still clocks in are dropped.
+static void DiscardISR(void)
+{
+	ReadFifo();
+}
+
+// Runs one step of the framing state machine.  Called from the interrupt,
+// or from the polling loops with the interrupt masked.
+static inline void ServiceFifo(void)
+{
+#ifdef MRF_ISR_PROFILE
+	MRF_fifo_handler_t handler = fifoHandler;
+	uint16_t start = MRF_TIMER_READ();
+	uint16_t *worst = &isrProfile.other;
+
+	handler();
+
+	uint16_t cycles = MRF_TIMER_READ() - start;
+
+	if (handler == txPayloadHandler) worst = &isrProfile.txPayload[txKind];
+	else if (handler == rxPayloadHandler) worst = &isrProfile.rxPayload[rxKind];
+
+	if (cycles > *worst) *worst = cycles;
+#else
+	fifoHandler();
+#endif
+}
+
+ISR(MRF_IRO_VECTOR, ISR_BLOCK)
+{
+	mrf_alive = 1;
+	
+	// There was no FIFO flag, just leave.
+	if (!FifoReady()) 
+	{
+		MRF_TRACE_EVENT(MRF_TRACE_SPURIOUS, 0);
+		return;
+	}
+
+	ServiceFifo();
+}
+
+// Registers written at bring-up unless Begin() was given a replacement
+static const uint16_t startupRegisters[] PROGMEM = {
+	MRF_GENCREG_SET,			// From the header: 434mhz, 10pF
+	MRF_TXCREG  | MRF_MODBW_30K | MRF_OTXPWR_0,
+	MRF_RXCREG  | MRF_FINTDIO   | MRF_RXBW_67K | MRF_DRSSIT_103db,
+	MRF_BBFCREG | MRF_ACRLC | (4 & MRF_DQTI_MASK),
+	MRF_AFCCREG_SET,
+};
+
+#define MRF_STARTUP_DEFAULTS (sizeof(startupRegisters) / sizeof(startupRegisters[0]))
+
+// Bring-up phases
+#define MRF_BOOT_DONE		0
+#define MRF_BOOT_REGISTERS	1	// Writing the registers, one per step
+#define MRF_BOOT_OSCILLATOR	2	// Waiting for the crystal
+#define MRF_BOOT_TUNING		3	// Transmitter on, tuning the antenna
+
+static uint8_t bootState;
+static uint8_t bootIndex;
+static uint8_t bootCount;
+static const uint16_t *bootRegisters;
+static uint32_t bootStart;
+static uint32_t startupTime;
+
+// The command bits of a register write, the rest of the word is its value
+static uint16_t RegisterCommand(uint16_t value)
+{
+	if ((value & 0xF000) == MRF_CFSREG) return MRF_CFSREG;
+	if ((value & 0xF800) == MRF_RXCREG) return MRF_RXCREG;
+	if ((value & 0xFE00) == MRF_TXCREG) return MRF_TXCREG;
+
+	return value & 0xFF00;
+}
+
+static uint8_t Replaced(uint16_t value)
+{
+	uint16_t command = RegisterCommand(value);
+
+	for (uint8_t i = 0; i < bootCount; i++) 
+	{
+		if (RegisterCommand(bootRegisters[i]) == command) return 1;
+	}
+
+	return 0;
+}
+
+void MRF49XA_t::Initialize(void)
+{
+	Begin(NULL, 0);
+
+	while (!Startup());
+}
+
+void MRF49XA_t::Begin(const uint16_t *registers, uint8_t count)
+{
+	bootStart = micros();
+
+	fiforstregUser = MRF_DRSTM;
+	// The Chip Select is the only SPI pin that needs to be set here.
+    // The rest are taken care of in the SPI init function.
+    
+	// Enable the IRO pin as input w/o pullup
+	MRF_IRO_PORTx &= ~(1 << MRF_IRO_BIT);
+	MRF_IRO_DDRx  &= ~(1 << MRF_IRO_BIT);
+	
+	// Enable the CS line as output with high value
+	MRF_CS_PORTx  |=  (1 << MRF_CS_BIT);
+	MRF_CS_DDRx   |=  (1 << MRF_CS_BIT);
+	
+	// Enable the FSEL as output with high value (default, low for receive)
+	MRF_FSEL_PORTx |= (1 << MRF_FSEL_BIT);
+	MRF_FSEL_DDRx  |= (1 << MRF_FSEL_BIT);
+	
+	// Enable the External interrupt for the IRO pin (falling edge)
+    MRF_INT_SETUP();
+	
+	// Start the crystal first, it takes the longest
+	RegisterSet(MRF_FIFOSTREG_SET);             // Set 8 bit FIFO interrupt count
+	PowerSet(MRF_OSCEN);
+
+	bootRegisters = registers;
+	bootCount = registers ? count : 0;
+	bootIndex = 0;
+	bootState = MRF_BOOT_REGISTERS;
+
+	powerState = MRF_POWER_ON;
+	wakeLatency = 0;
+	
+	// Setup the packet buffers
+	Pool.Begin();
+
+	rxReadyHead  = 0;
+	rxReadyCount = 0;
+	txHandle  = MRF_HANDLE_NONE;
+	appHandle = MRF_HANDLE_NONE;
+	rxHandle  = Pool.Allocate(MRF_OWNER_RX, 0);
+	receiving_packet = Pool.Get(rxHandle);
+
+	MRF_TRACE_BEGIN();
+
+#ifdef MRF_ISR_PROFILE
+	MRF_PROFILE_TIMER_SETUP();
+	ClearIsrProfile();
+#endif
+
+    mrf_state = MRF_STARTING;
+}
+
+uint8_t MRF49XA_t::Startup(void)
+{
+	uint32_t elapsed = micros() - bootStart;
+
+	switch (bootState) 
+	{
+		case MRF_BOOT_REGISTERS:
+			// The defaults nothing replaces, then the given set
+			while (bootIndex < MRF_STARTUP_DEFAULTS + bootCount) 
+			{
+				uint8_t i = bootIndex++;
+
+				if (i >= MRF_STARTUP_DEFAULTS) 
+				{
+					SetRegister(bootRegisters[i - MRF_STARTUP_DEFAULTS]);
+					return 0;
+				}
+
+				uint16_t value = pgm_read_word(&startupRegisters[i]);
+
+				if (Replaced(value)) continue;
+
+				RegisterSet(value);
+				return 0;
+			}
+
+			bootState = MRF_BOOT_OSCILLATOR;
+			// Fall through
+
+		case MRF_BOOT_OSCILLATOR:
+			if (elapsed < MRF_BOOT_OSC_US) return 0;
+
+			// antenna tuning on startup
+			PowerSet(MRF_TXCEN);
+			bootState = MRF_BOOT_TUNING;
+			return 0;
+
+		case MRF_BOOT_TUNING:
+			if (elapsed < MRF_BOOT_OSC_US + MRF_BOOT_TUNE_US) return 0;
+
+			// turn off transmitter, turn on receiver
+			PowerSet(MRF_RXCEN);
+			RegisterSet(MRF_GENCREG_SET | MRF_FIFOEN);
+			RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
+			RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser | MRF_FSCF);
+
+			// Dummy read of status registers to clear Power on reset flag
+			mrf_status = ReadStatus();
+
+			startupTime = elapsed;
+			bootState = MRF_BOOT_DONE;
+			bootRegisters = NULL;
+
+			packetCounter = 0;
+			SetHandler(IdleISR);
+			mrf_state = MRF_IDLE;
+
+			// Enable interrupt last, just in case they're already globally enabled
+			MRF_INT_MASK();
+			break;
+	}
+
+	return 1;
+}
+
+uint32_t MRF49XA_t::GetStartupTime(void)
+{
+	return startupTime;
+}
+
+uint8_t MRF49XA_t::IsIdle(void)
+{
+	if (mrf_state == MRF_IDLE) return 1;
+	
+	return 0;
+}
+
+// This function checks the alive flag in the ISR.
+// If for whatever reason the ISR doesn't fire since the last
+// time checked return 0, unless the module is idle.
+// Otherwise, if the ISR has run since last time, send 1.
+uint8_t MRF49XA_t::IsAlive(void)
+{
+	if (mrf_alive) 
+	{
+		mrf_alive = 0;
+		return 1;
+	} 
+	
+
+	if (mrf_state == MRF_IDLE || mrf_state == MRF_STARTING) return 1;	
+	return 0;
+}
+
+uint16_t MRF49XA_t::ReadStatus(void)
+{
+	return StatusRead();
+}
+
+void MRF49XA_t::SetRegister(uint16_t value)
+{
+	// We need to detect whether the FIFORSTREG is being set.  There are user
+    // flags and core flags in the same register, therefore, we need to save
+    // the user parts of it, and bitwise-OR them with the core flags.
+    if ((value & 0xFF00) == MRF_FIFORSTREG) 
+    {
+        fiforstregUser = value & (MRF_DRSTM | MRF_SYCHLEN); // Filter-out all but the user fields
+        return;
+    }
+
+    // The transmitter sends the sync byte itself, so keep it in step
+    if ((value & 0xFF00) == MRF_SYNBREG) syncByte = value & MRF_SYNCB;
+    
+    RegisterSet(value);
+}
+
+// Writes a whole register set in one sequence (e.g. a saved configuration)
+void MRF49XA_t::SetRegisters(const uint16_t *values, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++) SetRegister(values[i]);
+}
+
+// Waits for the transceiver to be idle and claims it for transmitting
+static void ClaimTransmitter(void)
+{
+	uint8_t wait = 1;
+
+	// Sending needs the transceiver up, and the synthesizer settled
+	if (mrf_state == MRF_STARTING) while (!MRF49XA.Startup());
+	if (powerState != MRF_POWER_ON) MRF49XA.Resume();
+
+	while ((uint32_t)(micros() - wakeStart) < wakeLatency);
+	wakeLatency = 0;
+
+	// We can check, without synchronization
+	// (because it doesn't change in the ISR)
+	// Whether we're in a testing mode.
+    // If we are, reset the device and proceed
+	if (mrf_state & MRF_TX_TEST_MASK) MRF49XA.Reset();
+	
+	// Wait for the module to be idle (this is cheezy synchronization)
+	do 
+	{
+		noInterrupts();			// Disable interrupts, this is a critical section
+
+		if (mrf_state == MRF_IDLE) 
+		{
+			mrf_state = MRF_TRANSMIT_PACKET;
+			fifoHandler = DiscardISR;
+			wait = 0;
+			interrupts();		// Atomic operation complete, reenable interrupts
+		} 
+		else 
+		{
+			interrupts();		// Atomic operation complete, reenable interrupts
+			delay(1);			// This should be roughly 1 byte period
+		}
+	} 
+	while (wait);
+}
+
+// Gives up a claimed transmitter without sending anything
+static void AbandonTransmit(uint8_t type)
+{
+	PostEvent(MRF_EVENT_TX_FAILED, type);
+	ReleaseTransmitter();
+
+	mrf_state = MRF_IDLE;
+	SetHandler(IdleISR);
+}
+
+// Claims the transmitter along with a buffer from the pool.  Returns 0 if
+// the pool is empty, the transmitter is released again.
+static uint8_t ClaimTransmitBuffer(uint8_t type)
+{
+	ClaimTransmitter();
+
+	MRF_handle_t handle = Pool.Allocate(MRF_OWNER_TX, 0);
+
+	if (handle == MRF_HANDLE_NONE) 
+	{
+		AbandonTransmit(type);
+		return 0;
+	}
+
+	TakeTransmitter(handle);
+
+	return 1;
+}
+
+// Gives an encrypted tx_packet its nonce.  Without a key (or nonces) the
+// frame can't be sent, the transmitter is released again.  Nor can it be
+// without an address: the epoch and counter run the same on every node, so
+// two unaddressed nodes would send the same nonces and keystream.
+static uint8_t NonceTransmit(void)
+{
+	if (!(tx_packet->type & PACKET_FLAG_ENCRYPTED)) return 1;
+
+	if (Crypto.HasKey() && nodeAddress != MRF_ADDRESS_BROADCAST &&
+		Crypto.NextNonce(tx_packet->nonce, nodeAddress)) return 1;
+
+	AbandonTransmit(tx_packet->type);
+
+	return 0;
+}
+
+// The first encrypted frame reserves the nonce epoch, which writes the
+// EEPROM; that's done before the transmitter is claimed
+static inline void PrepareTransmit(uint8_t type)
+{
+	if (type & PACKET_FLAG_ENCRYPTED) Crypto.ReserveEpoch();
+}
+
+// Sends the frame in tx_packet for the application
+static void TransmitClaimed(void)
+{
+    // Stamp our own relayed frames, and remember them so the copies that
+    // come back from repeaters are dropped
+    if (tx_packet->type & PACKET_FLAG_RELAY) 
+    {
+        tx_packet->source   = nodeAddress;
+        tx_packet->sequence = relaySequence++;
+
+        if (tx_packet->hops == 0) tx_packet->hops = RELAY_HOPS_TTL(0, RELAY_TTL_DEFAULT);
+
+        noInterrupts();
+        RelaySeen(tx_packet->source, tx_packet->sequence);
+        interrupts();
+    }
+
+	if (!NonceTransmit()) return;
+
+	txNotify = 1;
+	StartTransmit();
+}
+
+void MRF49XA_t::TransmitPacket(MRF_packet_t *packet)
+{
+	PrepareTransmit(packet->type);
+
+	if (!ClaimTransmitBuffer(packet->type)) return;
+
+    // Copy the packet
+    CopyPacket(tx_packet, packet);
+
+	TransmitClaimed();
+}
+
+// The buffer goes to the transmitter as it is and back to the pool once
+// it has been sent
+void MRF49XA_t::TransmitHandle(MRF_handle_t handle)
+{
+	if (Pool.Owner(handle) != MRF_OWNER_APP) return;
+
+	PrepareTransmit(Pool.Get(handle)->type);
+	ClaimTransmitter();
+	TakeTransmitter(handle);
+	TransmitClaimed();
+}
+
+MRF_handle_t MRF49XA_t::ReceiveHandle(void)
+{
+	MRF_handle_t handle = MRF_HANDLE_NONE;
+
+	noInterrupts();
+
+	if (rxReadyCount) 
+	{
+		handle = rxReady[rxReadyHead];
+		if (++rxReadyHead == MRF_POOL_LEN) rxReadyHead = 0;
+		rxReadyCount--;
+
+		finishedInfo = frameInfo[handle];
+		Pool.Give(handle, MRF_OWNER_APP);
+	}
+
+	interrupts();
+
+	return handle;
+}
+
+// The packet returned last time goes back to the pool first
+MRF_packet_t* MRF49XA_t::ReceivePacket(void)
+{
+	Pool.Free(appHandle);
+
+	appHandle = ReceiveHandle();
+
+	return Pool.Get(appHandle);
+}
+
+uint16_t MRF49XA_t::GetErrorCount(uint8_t error)
+{
+	uint16_t count;
+
+	if (error >= MRF_ERROR_CLASSES) return 0;
+
+	noInterrupts();
+	count = errorCounts[error];
+	interrupts();
+
+	return count;
+}
+
+void MRF49XA_t::ClearErrors(void)
+{
+	noInterrupts();
+	for (uint8_t i = 0; i < MRF_ERROR_CLASSES; i++) errorCounts[i] = 0;
+	interrupts();
+}
+
+// Link information for the packet last returned by ReceivePacket() or
+// ReceiveHandle()
+MRF_frame_info_t MRF49XA_t::GetFrameInfo(void)
+{
+	MRF_frame_info_t info;
+
+	noInterrupts();
+	info = finishedInfo;
+	interrupts();
+
+	return info;
+}
+
+uint32_t MRF49XA_t::GetTransmitTime(void)
+{
+	uint32_t time;
+
+	noInterrupts();
+	time = txTimestamp;
+	interrupts();
+
+	return time;
+}
+
+#ifdef MRF_ISR_PROFILE
+void MRF49XA_t::GetIsrProfile(MRF_isr_profile_t *profile)
+{
+	noInterrupts();
+	*profile = isrProfile;
+	interrupts();
+}
+
+void MRF49XA_t::ClearIsrProfile(void)
+{
+	noInterrupts();
+	memset(&isrProfile, 0, sizeof(isrProfile));
+	interrupts();
+}
+#endif
+
+void MRF49XA_t::OnReceive(MRF_receive_handler_t handler)
+{
+	receiveHandler = handler;
+}
+
+void MRF49XA_t::OnTransmitDone(MRF_event_handler_t handler)
+{
+	txDoneHandler = handler;
+}
+
+void MRF49XA_t::OnTransmitFailed(MRF_event_handler_t handler)
 {
-    uint8_t maxPacketCounter = 0;
-    
-    // ECC payloads are twice as large as advertised
-    if (Tx_packet.type == PACKET_TYPE_SERIAL_ECC || Tx_packet.type == PACKET_TYPE_PACKET_ECC) 
-    {
-        maxPacketCounter = (Tx_packet.payloadSize * 2) + MRF_TX_PACKET_OVERHEAD;
-    } 
-    else 
-    {
-        maxPacketCounter = Tx_packet.payloadSize + MRF_TX_PACKET_OVERHEAD;
-    }
-    
-    // Test whether we're done transmitting
-    if (packetCounter >= maxPacketCounter) 
-    {
-        // Disable transmitter, enable receiver
-        RegisterSet(MRF_PMCREG | MRF_RXCEN);
-        RegisterSet(MRF_GENCREG_SET | MRF_FIFOEN);
-        RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
-        RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser | MRF_FSCF);
-        
-        // Return the state
-        mrf_state = MRF_IDLE;
-        packetCounter = 0;
-    }
-    
-    switch (packetCounter) 
-    {
-        case 0:         // First byte is 'AA' for a alternating tone
-            RegisterSet(MRF_TXBREG | 0x00AA);
-            break;
-        case 1:         // First of two synchronization bytes
-            RegisterSet(MRF_TXBREG | 0x002D);
-            break;
-        case 2:         // Second of two synchronization bytes
-            RegisterSet(MRF_TXBREG | 0x00D4);
-            break;
-        case 3:         // Size byte
-            RegisterSet(MRF_TXBREG | Tx_packet.payloadSize);
-            break;
-        case 4:         // Type byte
-            RegisterSet(MRF_TXBREG | Tx_packet.type);
-            break;
-            
-        default:        // Payload
-            // It matters which mode we're in.
-            // If we're in an ECC mode, we transmit hamming-coded
-            // high-nibbles on high-packet
-            if (Tx_packet.type == PACKET_TYPE_SERIAL_ECC || Tx_packet.type == PACKET_TYPE_PACKET_ECC) 
-            {
-                // Calculate the payload byte we're using (divide by 2)
-                uint8_t payloadByte = Tx_packet.payload[(packetCounter - 5) >> 1];
-
-                // If the payload index is odd, we're transmitting the high nibble
-                if ((packetCounter - 5) & 0x01) 
-                {
-                    RegisterSet(MRF_TXBREG | Hamming.EncodeNibble(payloadByte >> 4));
-                }
-                // Otherwise, it's the low nibble
-                else 
-                {
-                    RegisterSet(MRF_TXBREG | Hamming.EncodeNibble(payloadByte & 0x0F));
-                }
-                
-            } 
-            else 
-            {
-                // The 5 is from the preamble, 2 sync bytes, size and type bytes.
-                // Later, we'll need to include ECC calculation here.
-                RegisterSet(MRF_TXBREG | Tx_packet.payload[packetCounter - 5]);
-            }
-            
-            break;
-    }
-    
-    packetCounter += 1;
+	txFailedHandler = handler;
 }
 
-// If this ISR function is called, we've recieved the payload length and nothing else
-static inline void ReceiveISR(void)
+void MRF49XA_t::OnLinkError(MRF_event_handler_t handler)
 {
-	uint8_t bl = ReadFifo();
-    
-    if (packetCounter == 1) 
-    {
-        // We're recieving the type field
-        receiving_packet->type = bl;
-        packetCounter++;
-        return;
-    }
-    
-    // We've got the type field, so we know whether it's ECC, and 2x the size
-    uint8_t maxPacketCounter = receiving_packet->payloadSize + MRF_PACKET_OVERHEAD;
+	linkErrorHandler = handler;
+}
 
-    if (receiving_packet->type == PACKET_TYPE_SERIAL_ECC || receiving_packet->type == PACKET_TYPE_PACKET_ECC) 
-    {
-        maxPacketCounter = (receiving_packet->payloadSize * 2) + MRF_PACKET_OVERHEAD;
-        
-        // Get the location into the payload field
-        uint8_t index = (packetCounter - MRF_PACKET_OVERHEAD) >> 1;
-        
-        // If the packet counter is odd, we're recieving the high nibble
-        // The packet is cleared out beforehand, so we can just or-in the new info
-        if ((packetCounter - MRF_PACKET_OVERHEAD) & 0x01) 
-        {
-            receiving_packet->payload[index] |= Hamming.DecodeNibble(bl) << 4;
-        }
-        // Otherwise, we're receiving the low nibble
-        else 
-        {
-            receiving_packet->payload[index] |= Hamming.DecodeNibble(bl) & 0x0F;
-        }
-    } 
-    else 
-    {
-        receiving_packet->payload[packetCounter - MRF_PACKET_OVERHEAD] = bl;
-    }
+// Runs the handlers for every queued event.  The handlers may transmit,
+// the interrupt keeps queueing behind them.
+uint8_t MRF49XA_t::Dispatch(void)
+{
+	uint8_t handled = 0;
+	uint8_t lost;
 
-    packetCounter++;
-    
-    // End of packet?
-    if (packetCounter >= maxPacketCounter) 
-    {
-        // Reset the FIFO
-        RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
-        RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser | MRF_FSCF);
-        
-        // Swap packet structures
-        finished_packet = receiving_packet;
-        hasPacket = 1;
+	noInterrupts();
+	lost = eventsLost;
+	eventsLost = 0;
+	interrupts();
 
-        if (receiving_packet == &Rx_Packet_a) receiving_packet =  &Rx_Packet_b;
-        else receiving_packet =  &Rx_Packet_a;
-        
-        // Restore state
-        mrf_state = MRF_IDLE;
-        packetCounter = 0;
-        receiving_packet->payloadSize = 0;
-    }
-}
+	if (lost) 
+	{
+		noInterrupts();
+		errorCounts[MRF_ERROR_EVENTS] += lost;
+		if (errorCounts[MRF_ERROR_EVENTS] < lost) errorCounts[MRF_ERROR_EVENTS] = 0xFFFF;
+		interrupts();
 
-ISR(MRF_IRO_VECTOR, ISR_BLOCK)
-{
-	// Set the MRF's CS pin low
-	MRF_CS_PORTx &= ~(1 << MRF_CS_BIT);
+		if (linkErrorHandler) linkErrorHandler(MRF_ERROR_EVENTS);
+	}
 
-	// This needs to be here to delay for the synchronizer
-	mrf_alive = 1;
-	
-	// the MISO pin marks whether the FIFO needs attention
-	if (digitalRead(MISO))
+	while (eventTail != eventHead) 
 	{
-		switch (mrf_state) 
+		MRF_event_t current = events[eventTail];
+		eventTail = (eventTail + 1) & (MRF_EVENT_QUEUE_LEN - 1);
+
+		switch (current.event) 
 		{
-			case MRF_IDLE:              // Passively receiving
-                IdleISR();
-                break;
-
-			case MRF_TRANSMIT_PACKET:   // Actively transmitting
-                TransmitISR();
-                break;
-								
-			case MRF_RECEIVE_PACKET:	// We've received at least the size
-				ReceiveISR();
+			case MRF_EVENT_RECEIVED:
+				// The frame may already have been polled.  Its buffer goes
+				// back to the pool when the handler returns.
+				if (receiveHandler) 
+				{
+					MRF_handle_t handle = ReceiveHandle();
+
+					if (handle != MRF_HANDLE_NONE) 
+					{
+						receiveHandler(Pool.Get(handle));
+						Pool.Free(handle);
+					}
+				}
 				break;
 
-			case MRF_TRANSMIT_ZERO:
-				RegisterSet(MRF_TXBREG | 0x0000);
+			case MRF_EVENT_TX_DONE:
+				if (txDoneHandler) txDoneHandler(current.data);
 				break;
-				
-			case MRF_TRANSMIT_ONE:
-				RegisterSet(MRF_TXBREG | 0x00FF);
+
+			case MRF_EVENT_TX_FAILED:
+				if (txFailedHandler) txFailedHandler(current.data);
 				break;
-				
-			case MRF_TRANSMIT_ALT:
-				RegisterSet(MRF_TXBREG | 0x00AA);
+
+			case MRF_EVENT_LINK_ERROR:
+				if (linkErrorHandler) linkErrorHandler(current.data);
 				break;
-				
+
 			default:
 				break;
 		}
-	} 
-	// There was no FIFO flag, just leave.
-	else 
-	{
-		MRF_CS_PORTx |=  (1 << MRF_CS_BIT);
-		return;
-	}	
+
+		handled++;
+	}
+
+	return handled;
 }
 
-void MRF49XA_t::Initialize(void)
+uint8_t MRF49XA_t::StreamHeader(MRF_stream_t *stream)
 {
-	fiforstregUser = MRF_DRSTM;
-	// The Chip Select is the only SPI pin that needs to be set here.
-    // The rest are taken care of in the SPI init function.
-    
-	// Enable the IRO pin as input w/o pullup
-	MRF_IRO_PORTx &= ~(1 << MRF_IRO_BIT);
-	MRF_IRO_DDRx  &= ~(1 << MRF_IRO_BIT);
-	
-	// Enable the CS line as output with high value
-	MRF_CS_PORTx  |=  (1 << MRF_CS_BIT);
-	MRF_CS_DDRx   |=  (1 << MRF_CS_BIT);
-	
-	// Enable the FSEL as output with high value (default, low for receive)
-	MRF_FSEL_PORTx |= (1 << MRF_FSEL_BIT);
-	MRF_FSEL_DDRx  |= (1 << MRF_FSEL_BIT);
-	
-	// Enable the External interrupt for the IRO pin (falling edge)
-    MRF_INT_SETUP();
-	
-	// configuring the MRF49XA radio
-	RegisterSet(MRF_FIFOSTREG_SET);             // Set 8 bit FIFO interrupt count
-	RegisterSet(MRF_FIFOSTREG_SET | MRF_FSCF);	// Enable sync. latch
-	RegisterSet(MRF_GENCREG_SET);               // From the header: 434mhz, 10pF
-    RegisterSet(MRF_PMCREG | MRF_CLKODIS);      // Shutdown everything
-
-    RegisterSet(MRF_TXCREG  | MRF_MODBW_30K | MRF_OTXPWR_0);
-    RegisterSet(MRF_RXCREG  | MRF_FINTDIO   | MRF_RXBW_67K | MRF_DRSSIT_103db);
-    RegisterSet(MRF_BBFCREG | MRF_ACRLC | (4 & MRF_DQTI_MASK));
-
-    // antenna tuning on startup
-    RegisterSet(MRF_PMCREG | MRF_CLKODIS | MRF_TXCEN); // turn on the transmitter
-    delay(5);                            // wait for oscillator to stablize
-	// end of antenna tuning
-	
-	// turn off transmitter, turn on receiver
-    RegisterSet(MRF_PMCREG | MRF_CLKODIS | MRF_RXCEN);
-    RegisterSet(MRF_GENCREG_SET | MRF_FIFOEN);
-	RegisterSet(MRF_FIFOSTREG_SET);
-	RegisterSet(MRF_FIFOSTREG_SET | MRF_FSCF);
-	
-	// Setup the packet pointers
-	receiving_packet = &Rx_Packet_a;
-	
-	// Dummy read of status registers to clear Power on reset flag
-	mrf_status = ReadStatus();
-	
-    mrf_state = MRF_IDLE;
-    
-	// Enable interrupt last, just in case they're already globally enabled
-	MRF_INT_MASK();
+	uint8_t fresh = 0;
+
+	noInterrupts();
+
+	if (streamState != 0 && stream->sequence != streamSequence) 
+	{
+		stream->packet     = (MRF_packet_t *)streamPacket;
+		stream->sequence   = streamSequence;
+		stream->read       = 0;
+		stream->handle     = streamHandle;
+		stream->generation = Pool.Generation(streamHandle);
+		fresh = 1;
+	}
+
+	interrupts();
+
+	return fresh;
 }
 
-uint8_t MRF49XA_t::IsIdle(void)
+// The frame's buffer stays the same while its sequence is the current one
+// and it hasn't been freed.  Once committed it goes to the application,
+// which may free it and have it reused (received or sent into, or
+// forwarded from) without a new header.
+static inline uint8_t StreamValid(MRF_stream_t *stream)
 {
-	if (mrf_state == MRF_IDLE) return 1;
-	
-	return 0;
+	return stream->sequence == streamSequence &&
+		stream->generation == Pool.Generation(stream->handle);
 }
 
-// This function checks the alive flag in the ISR.
-// If for whatever reason the ISR doesn't fire since the last
-// time checked return 0, unless the module is idle.
-// Otherwise, if the ISR has run since last time, send 1.
-uint8_t MRF49XA_t::IsAlive(void)
+// Only frames still arriving or committed are read from, a dropped one may
+// already be going out again from the same buffer as an echo or forward
+static inline uint8_t StreamReadable(MRF_stream_t *stream)
 {
-	if (mrf_alive) 
-	{
-		mrf_alive = 0;
-		return 1;
-	} 
-	
+	uint8_t state = streamState;
 
-	if (mrf_state == MRF_IDLE) return 1;	
-	return 0;
+	return StreamValid(stream) && (state == MRF_STREAM_ACTIVE || state == MRF_STREAM_COMMIT);
 }
 
-uint16_t MRF49XA_t::ReadStatus(void)
+// Copies the payload bytes that arrived since the last call.  The copy
+// runs with interrupts enabled, and the buffer is checked again
+// afterwards: if it was reused meanwhile the bytes are discarded.
+uint8_t MRF49XA_t::StreamRead(MRF_stream_t *stream, uint8_t *data, uint8_t length)
 {
-	uint16_t retval = 0x0000;
+	uint8_t count;
 
-	retval |= SPI.transfer(0x00);
-	retval << 8;
+	if (!StreamReadable(stream)) return 0;
 
-	retval |= SPI.transfer(0x00);
+	count = streamAvailable - stream->read;
+	if (count > length) count = length;
 
-	return retval;
+	for (uint8_t i = 0; i < count; i++) data[i] = stream->packet->payload[stream->read + i];
+
+	if (!StreamReadable(stream)) return 0;
+
+	stream->read += count;
+
+	return count;
 }
 
-void MRF49XA_t::SetRegister(uint16_t value)
+uint8_t MRF49XA_t::StreamStatus(MRF_stream_t *stream)
 {
-	// We need to detect whether the FIFORSTREG is being set.  There are user
-    // flags and core flags in the same register, therefore, we need to save
-    // the user parts of it, and bitwise-OR them with the core flags.
-    if ((value & 0xFF00) == MRF_FIFORSTREG) 
-    {
-        fiforstregUser = value & (MRF_DRSTM | MRF_SYCHLEN); // Filter-out all but the user fields
-        return;
-    }
-    
-    RegisterSet(value);
+	uint8_t state;
+
+	noInterrupts();
+	state = StreamValid(stream) ? streamState : MRF_STREAM_LOST;
+	interrupts();
+
+	return state;
 }
 
-void MRF49XA_t::TransmitPacket(MRF_packet_t *packet)
+void MRF49XA_t::SetRawReceive(uint8_t enable)
 {
-	uint8_t	i;
-	uint8_t wait = 1;
+	rawReceive = enable;
+}
 
-	// We can check, without synchronization
-	// (because it doesn't change in the ISR)
-	// Whether we're in a testing mode.
-    // If we are, reset the device and proceed
-	if (mrf_state & MRF_TX_TEST_MASK) Reset();
-	
-	// Wait for the module to be idle (this is cheezy synchronization)
-	do 
-	{
-		noInterrupts();			// Disable interrupts, this is a critical section
+// In burst mode the IRO interrupt is masked and the FIFO flag is polled in
+// a tight loop, so every byte costs one pin read instead of an interrupt
+// entry and exit.  At the top data rates this is the only way an AVR keeps
+// up.  Other interrupts (millis, serial) keep running.
+void MRF49XA_t::TransmitPacketPolled(MRF_packet_t *packet)
+{
+	// Nothing advances the bring-up while polling, and both it and Resume()
+	// end by enabling the interrupt, so they're done first
+	if (mrf_state == MRF_STARTING) while (!Startup());
+	if (powerState != MRF_POWER_ON) Resume();
 
-		if (mrf_state == MRF_IDLE) 
-		{
-			mrf_state = MRF_TRANSMIT_PACKET;
-			wait = 0;
-			interrupts();		// Atomic operation complete, reenable interrupts
-		} 
-		else 
-		{
-			interrupts();		// Atomic operation complete, reenable interrupts
-			delay(1);			// This should be roughly 1 byte period
-		}
-	} 
-	while (wait);
+	MRF_INT_DISABLE();
 
-	// Initialize the constant parts of the transmit buffer
-	packetCounter = 0;
+	// Finish any frame that's in progress, TransmitPacket waits for idle
+	if (!(mrf_state & MRF_TX_TEST_MASK))
+	{
+		while (mrf_state != MRF_IDLE) if (FifoReady()) ServiceFifo();
+	}
 
-    // Copy the packet
-    Tx_packet.payloadSize = packet->payloadSize;
-    Tx_packet.type        = packet->type;
-    
-    for (i = 0; i < packet->payloadSize; i++) Tx_packet.payload[i] = packet->payload[i];
+	TransmitPacket(packet);
 
-	RegisterSet(MRF_PMCREG);					// Turn everything off
-	RegisterSet(MRF_GENCREG_SET | MRF_TXDEN);	// Enable TX FIFO
-	// Reset value of TX FIFO is 0xAAAA
-	
-	RegisterSet(MRF_PMCREG | MRF_TXCEN);		// Begin transmitting
-	// Everything else is handled in the ISR
+	while (mrf_state != MRF_IDLE) if (FifoReady()) ServiceFifo();
+
+	MRF_INT_MASK();
 }
 
-MRF_packet_t* MRF49XA_t::ReceivePacket(void)
+MRF_packet_t* MRF49XA_t::ReceivePacketPolled(uint16_t timeout)
 {
-	if (hasPacket)
+	uint32_t start = millis();
+
+	if (mrf_state == MRF_STARTING) while (!Startup());
+	if (powerState != MRF_POWER_ON) Resume();
+
+	MRF_INT_DISABLE();
+
+	while (!rxReadyCount && (uint16_t)(millis() - start) < timeout) 
 	{
-		hasPacket = 0;
-		return (MRF_packet_t *)finished_packet;
+		if (FifoReady()) ServiceFifo();
 	}
 
-	return 0;
+	// A partially received frame is finished by the interrupt
+	MRF_INT_MASK();
+
+	return ReceivePacket();
 }
 
 // TODO: Missing?
@@ -443,11 +1792,43 @@ void MRF49XA_t::SetFrequency(uint16_t freqb)
     freqb = freqb & MRF_FREQB_MASK;
     
     // Make sure it's within the range (do nothing if its not)
-    if (freqb < 97 || freqb > 3903) return;
+    if (freqb < MRF_FREQB_MIN || freqb > MRF_FREQB_MAX) return;
     
     RegisterSet(MRF_CFSREG | freqb);
 }
 
+void MRF49XA_t::SetAddress(uint8_t address)
+{
+	nodeAddress = address;
+}
+
+uint8_t MRF49XA_t::GetAddress(void)
+{
+	return nodeAddress;
+}
+
+void MRF49XA_t::SetNetwork(uint8_t sync)
+{
+	SetRegister(MRF_SYNBREG | sync);
+}
+
+void MRF49XA_t::SetPreamble(uint8_t length)
+{
+	txPreambleLength = length;
+}
+
+void MRF49XA_t::SetRepeater(uint8_t enable)
+{
+	repeater = enable;
+}
+
+void MRF49XA_t::SetRouter(MRF_router_t router)
+{
+	noInterrupts();
+	::router = router;
+	interrupts();
+}
+
 void MRF49XA_t::TransmitZero(void)
 {
 	// If we're already doing a spectrum test, just mark the new pattern
@@ -458,6 +1839,7 @@ void MRF49XA_t::TransmitZero(void)
 	}
 	
 	mrf_state = MRF_TRANSMIT_ZERO;
+	SetHandler(TestPatternISR);
     
 	// Enable the TX Register
 	RegisterSet(MRF_GENCREG_SET | MRF_TXDEN);
@@ -466,7 +1848,7 @@ void MRF49XA_t::TransmitZero(void)
 	RegisterSet(MRF_TXBREG | 0x0000);
 	
 	// Enable the transmitter
-	RegisterSet(MRF_PMCREG | MRF_CLKODIS | MRF_TXCEN);
+	PowerSet(MRF_TXCEN);
 	
 	// Upon completion of a byte !IRO should toggle
 	return;	
@@ -482,6 +1864,7 @@ void MRF49XA_t::TransmitOne(void)
 	}
 	
 	mrf_state = MRF_TRANSMIT_ONE;
+	SetHandler(TestPatternISR);
 	
 	// Enable the TX Register
 	RegisterSet(MRF_GENCREG_SET | MRF_TXDEN);
@@ -490,7 +1873,7 @@ void MRF49XA_t::TransmitOne(void)
 	RegisterSet(MRF_TXBREG | 0x00FF);
 	
 	// Enable the transmitter
-	RegisterSet(MRF_PMCREG | MRF_CLKODIS | MRF_TXCEN);
+	PowerSet(MRF_TXCEN);
 	
 	// Upon completion of a byte !IRO should toggle
 	return;	
@@ -506,6 +1889,7 @@ void MRF49XA_t::TransmitAlternating(void)
 	}
 	
 	mrf_state = MRF_TRANSMIT_ALT;
+	SetHandler(TestPatternISR);
 
 	// Enable the TX Register
 	RegisterSet(MRF_GENCREG_SET | MRF_TXDEN);
@@ -513,32 +1897,144 @@ void MRF49XA_t::TransmitAlternating(void)
 	// The transmit register is filled with 0xAAAA, we can leave it alone
 	
 	// Enable the transmitter
-	RegisterSet(MRF_PMCREG | MRF_CLKODIS | MRF_TXCEN);
+	PowerSet(MRF_TXCEN);
 	
 	// Upon completion of a byte !IRO should toggle
 	return;	
 }
 
-// TODO: Missing?
-void MRF49XA_t::PacketReflect(void)
+void MRF49XA_t::PacketReflect(uint8_t enable)
 {
-
+	reflect = enable;
 }
 
-// TODO: Missing?
-void MRF49XA_t::PacketGenerator(void)
+// Sends one link test request.  The header carries the sequence number and
+// the time the transmission started, the rest is a known fill pattern.
+void MRF49XA_t::PacketGenerator(uint8_t size, uint8_t type, uint16_t sequence)
 {
+	MRF_packet_t *packet;
+	uint8_t i;
+
+	if (size < LINKTEST_HEADER_LEN) size = LINKTEST_HEADER_LEN;
+	if (size > MRF_PAYLOAD_LEN) size = MRF_PAYLOAD_LEN;
+
+	// Claim the transmitter first, the packet is filled in place
+	PrepareTransmit(type);
+	if (!ClaimTransmitBuffer(type)) return;
+
+	packet = tx_packet;
+
+	packet->payloadSize = size;
+	packet->type        = type;
+	packet->address     = MRF_ADDRESS_BROADCAST;
+
+	for (i = LINKTEST_HEADER_LEN; i < size; i++) packet->payload[i] = i ^ (uint8_t)sequence;
+
+	uint32_t now = micros();
 
+	packet->payload[LINKTEST_OFFSET_KIND]     = LINKTEST_REQUEST;
+	packet->payload[LINKTEST_OFFSET_SEQUENCE] = sequence & 0xFF;
+	packet->payload[LINKTEST_OFFSET_SEQUENCE + 1] = sequence >> 8;
+
+	for (i = 0; i < 4; i++) packet->payload[LINKTEST_OFFSET_TIME + i] = now >> (8 * i);
+
+	if (!NonceTransmit()) return;
+
+	txNotify = 1;
+	StartTransmit();
 }
 
 void MRF49XA_t::Reset(void)
 {
-	RegisterSet(MRF_PMCREG);
+	MRF_TRACE_EVENT(MRF_TRACE_RESET, 0);
+
+	if (mrf_state == MRF_STARTING) 
+	{
+		while (!Startup());
+		return;
+	}
+
+	if (streamState == MRF_STREAM_ACTIVE) streamState = MRF_STREAM_ABORT;
+
+	// A frame that was being sent is lost
+	if (mrf_state == MRF_TRANSMIT_PACKET && txHandle != MRF_HANDLE_NONE) 
+	{
+		if (txNotify) PostEvent(MRF_EVENT_TX_FAILED, tx_packet->type);
+
+		ReleaseTransmitter();
+	}
+
+	PowerSet(MRF_OSCEN);
 	RegisterSet(MRF_FIFOSTREG_SET | fiforstregUser);
 	RegisterSet(MRF_GENCREG_SET);
 	RegisterSet(MRF_GENCREG_SET | MRF_FIFOEN);
 	RegisterSet(MRF_FIFOSTREG_SET | MRF_FSCF | fiforstregUser);
-	RegisterSet(MRF_PMCREG | MRF_RXCEN);	
+	PowerSet(MRF_RXCEN);
+
+    mrf_state = MRF_IDLE;
+    packetCounter = 0;
+    SetHandler(IdleISR);
+
+	if (powerState != MRF_POWER_ON) 
+	{
+		StartWake();
+		MRF_INT_MASK();
+	}
+}
+
+// Stops the interrupt and turns off all but the given chains
+static void PowerDown(uint16_t chains, uint8_t state)
+{
+	uint8_t wait = 1;
+
+	if (mrf_state == MRF_STARTING) while (!MRF49XA.Startup());
+	if (mrf_state & MRF_TX_TEST_MASK) MRF49XA.Reset();
+
+	// A frame being sent goes out first
+	do 
+	{
+		noInterrupts();
+
+		if (mrf_state != MRF_TRANSMIT_PACKET) 
+		{
+			MRF_INT_DISABLE();
+			wait = 0;
+		}
+
+		interrupts();
+	} while (wait);
+
+	PowerSet(chains);
 
-    mrf_status = MRF_IDLE;
+	// A frame being received is lost, and the FIFO starts out empty
+	RestartSync();
+
+	powerState = state;
+}
+
+void MRF49XA_t::Standby(void)
+{
+	PowerDown(MRF_OSCEN, MRF_POWER_STANDBY);
+}
+
+void MRF49XA_t::Sleep(void)
+{
+	PowerDown(0, MRF_POWER_SLEEP);
+}
+
+void MRF49XA_t::Resume(void)
+{
+	if (powerState == MRF_POWER_ON) return;
+
+	// The receiver chain brings the crystal and synthesizer up with it
+	PowerSet(MRF_RXCEN);
+	RestartSync();
+	StartWake();
+
+	MRF_INT_MASK();
+}
+
+uint8_t MRF49XA_t::GetPowerState(void)
+{
+	return powerState;
 }
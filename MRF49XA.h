@@ -16,6 +16,8 @@
 
 #include <Arduino.h>
 #include "MRF49XA_definitions.h"
+#include "PacketTypes.h"
+#include "Crypto.h"
 
 // The packet structure is now a mostly blank slate.  The size feild is
 // only includes the payload, not the size and type.  The type feild
@@ -26,26 +28,140 @@
 // included in the payloadSize field in the MRF_PACKET_OVERHEAD define.
 //
 // These defined may be used to access the maximum payload length in the app.
+//
+// The maximum payload length sizes the driver's three packet buffers, up
+// to the 255 bytes payloadSize can count.  Large frames cut the header
+// overhead on bulk links, small ones save SRAM.  It has to be the same for
+// the whole build, so set it here or as a compiler flag for everything
+// (e.g. -DMRF_PAYLOAD_LEN=200), not in the sketch.
+#ifndef MRF_PAYLOAD_LEN
 #define MRF_PAYLOAD_LEN        64
+#endif
 
-#define PACKET_TYPE_SERIAL     0x01
-#define PACKET_TYPE_SERIAL_ECC 0x02
-#define PACKET_TYPE_PACKET     0x03
-#define PACKET_TYPE_PACKET_ECC 0x04
+#if MRF_PAYLOAD_LEN < 1 || MRF_PAYLOAD_LEN > 255
+#error "MRF_PAYLOAD_LEN must be between 1 and 255"
+#endif
 
-typedef struct {
+// Packet storage for a given payload capacity.  MRF_packet_t is the size
+// the driver uses; smaller packets can be sent with TransmitPacket() too.
+template <uint8_t capacity>
+struct MRF_packet_storage_t {
     uint8_t  payloadSize;   // Total size of the payload
-    uint8_t  type;          // for now, set to 0xBD
-    uint8_t  payload[MRF_PAYLOAD_LEN];
-} MRF_packet_t;
+    uint8_t  type;          // Payload type and header flags
+    uint8_t  address;       // Destination, only sent if PACKET_FLAG_ADDRESSED
+    uint8_t  source;        // Relay header, only sent if PACKET_FLAG_RELAY
+    uint8_t  target;
+    uint8_t  sequence;
+    uint8_t  hops;          // RELAY_HOPS_TTL(), see PacketTypes.h
+    uint8_t  nonce[CRYPTO_NONCE_LEN];	// Set by the driver if PACKET_FLAG_ENCRYPTED
+    uint8_t  payload[capacity];
+};
+
+typedef MRF_packet_storage_t<MRF_PAYLOAD_LEN> MRF_packet_t;
+
+// Packet buffer in the pool, see Pool.h
+typedef uint8_t MRF_handle_t;
+
+#define MRF_HANDLE_NONE 0xFF
+
+// Link information recorded by the driver for every received frame.
+typedef struct {
+	uint16_t status;        // STSREG at the start of the frame
+	uint8_t  flags;         // MRF_INFO_* flags
+	uint8_t  corrections;   // Hamming symbols that needed correcting
+	uint32_t timestamp;     // micros() when the length byte after the sync word arrived
+} MRF_frame_info_t;
+
+#define MRF_INFO_RAW        0x01	// ECC payload holds undecoded symbols
+
+// Events posted by the interrupt and delivered by Dispatch()
+#define MRF_EVENT_RECEIVED   0x01	// data = type byte
+#define MRF_EVENT_TX_DONE    0x02	// data = type byte
+#define MRF_EVENT_TX_FAILED  0x03	// Frame aborted by a reset, data = type byte
+#define MRF_EVENT_LINK_ERROR 0x04	// data = MRF_ERROR_*
+
+// Link errors, by class.  Each one is recovered from as cheaply as it
+// allows: the receive errors only re-arm the sync latch (two FIFORSTREG
+// writes) instead of resetting the transceiver, so the next frame can be
+// caught right away.
+#define MRF_ERROR_LENGTH     0x01	// Nonsensical length byte, sync re-armed
+#define MRF_ERROR_OVERRUN    0x02	// No free buffer, the received frame is dropped
+#define MRF_ERROR_EVENTS     0x03	// The event queue overflowed
+#define MRF_ERROR_AUTH       0x04	// An encrypted frame failed authentication
+#define MRF_ERROR_FIFO       0x05	// RX FIFO overflowed in the frame, dropped
+#define MRF_ERROR_UNDERRUN   0x06	// TX register ran empty, TX failed is posted
+#define MRF_ERROR_SYNC       0x07	// Invalid type byte, sync was found in noise
+
+#define MRF_ERROR_CLASSES    8		// Size of the counter table, codes are 1 up
+
+// Number of events queued between Dispatch() calls, must be a power of 2
+#define MRF_EVENT_QUEUE_LEN  8
+
+// Streaming receive.  The application follows the frame the interrupt is
+// writing, see StreamHeader().
+typedef struct {
+	MRF_packet_t *packet;	// Header fields are valid, payload is filling in
+	uint8_t sequence;		// Frame being followed
+	uint8_t read;			// Payload bytes already returned by StreamRead()
+	MRF_handle_t handle;	// The frame's buffer, and its Pool.Generation()
+	uint8_t generation;
+} MRF_stream_t;
+
+#define MRF_STREAM_ACTIVE    0x01	// Frame still on the air
+#define MRF_STREAM_COMMIT    0x02	// Frame complete, also queued as usual
+#define MRF_STREAM_ABORT     0x03	// Frame dropped before it completed
+#define MRF_STREAM_LOST      0x04	// A newer frame started or the buffer
+									// was freed, fell behind
+#define MRF_STREAM_DROPPED   0x05	// Frame complete but not queued (echoed,
+									// passing through, duplicate, no buffer)
+
+// Worst-case Timer 1 cycles spent in the handler of one FIFO interrupt,
+// see GetIsrProfile().  The payload handlers are kept apart by the kind of
+// frame, MRF_ISR_KIND(): ECC, encrypted and whitened.
+#define MRF_ISR_KINDS        8
+#define MRF_ISR_KIND(type)   ((PACKET_TYPE_IS_ECC(type) ? 4 : 0) | \
+                              (((type) & PACKET_FLAG_ENCRYPTED) ? 2 : 0) | \
+                              (((type) & PACKET_FLAG_WHITENED) ? 1 : 0))
+
+typedef struct {
+	uint16_t txPayload[MRF_ISR_KINDS];
+	uint16_t rxPayload[MRF_ISR_KINDS];
+	uint16_t other;			// Every other handler
+} MRF_isr_profile_t;
+
+typedef void (*MRF_receive_handler_t)(MRF_packet_t *packet);
+
+// Returns the next hop towards target, or MRF_ADDRESS_BROADCAST to flood.
+// Called from the interrupt.
+typedef uint8_t (*MRF_router_t)(uint8_t target);
+typedef void (*MRF_event_handler_t)(uint8_t data);
 
 // These defines are used internally to the library, they include 
 // Packet overhead (length)
 #define MRF_PACKET_OVERHEAD 2
+// Extra header byte for addressed packets
+#define MRF_ADDRESS_OVERHEAD 1
+// Extra header bytes for relayed packets
+#define MRF_RELAY_OVERHEAD  RELAY_HEADER_LEN
+// Number of (source, sequence) pairs remembered for duplicate suppression,
+// must be a power of 2 and at most 8
+#define MRF_RELAY_CACHE_LEN 8
 // the maximum packet size for internal buffers
 #define MRF_PACKET_LEN      MRF_PAYLOAD_LEN + MRF_PACKET_OVERHEAD
 // Space for preamble, sync (2 bytes), length, type and dummy
 #define MRF_TX_PACKET_OVERHEAD 6
+// Bytes counted by the state machine besides the payload (sync, length,
+// type, every optional header field, tag and dummy)
+#define MRF_FRAME_OVERHEAD_MAX (2 + MRF_PACKET_OVERHEAD + MRF_ADDRESS_OVERHEAD + \
+                                MRF_RELAY_OVERHEAD + CRYPTO_NONCE_LEN + CRYPTO_TAG_LEN + 1)
+
+// Frame byte counter.  ECC payloads take two bytes on air per payload byte,
+// beyond 117 bytes of payload the frame doesn't fit an 8 bit counter.
+#if (2 * MRF_PAYLOAD_LEN + MRF_FRAME_OVERHEAD_MAX) > 255
+typedef uint16_t MRF_counter_t;
+#else
+typedef uint8_t MRF_counter_t;
+#endif
 
 // Bit position:   7  6  5  4  3  2  1  0
 // Normal modes:                 <X  X  X>
@@ -55,6 +171,7 @@ typedef struct {
 #define MRF_IDLE			0x00	// Listening for packets, nothing yet
 #define MRF_TRANSMIT_PACKET 0x01	// Actively transmitting a packet
 #define MRF_RECEIVE_PACKET  0x02	// Actively receiving a packet
+#define MRF_STARTING        0x04	// Bring-up in progress, see Begin()
 
 // Testing modes
 #define MRF_RECEIVE_ALL		0x20	// Not yet implemented
@@ -64,6 +181,11 @@ typedef struct {
 
 #define MRF_TX_TEST_MASK	0xC0	// Singles out spectrum test modes
 
+// Power states, see Sleep()
+#define MRF_POWER_ON		0x00	// Receiving, or sending
+#define MRF_POWER_STANDBY	0x01	// Crystal running, everything else off
+#define MRF_POWER_SLEEP		0x02	// Everything off
+
 /*******************************************************************************
  * This section of the header file includes the interface used by the user
  * application.  This includes an initialization routine, and functions to set
@@ -76,32 +198,181 @@ typedef struct {
 class MRF49XA_t
 {
 public:
-	// Initialize the transciever.
+	// Initialize the transciever.  Blocks while the crystal starts.
 	void Initialize(void);
 
+	// Non-blocking bring-up.  Begin() starts the crystal and returns; call
+	// Startup() from loop() until it returns 1.  The registers are written
+	// one per call while the crystal starts, then the antenna is tuned and
+	// the receiver turned on.  registers (may be NULL) replace the defaults
+	// of the same register, so each register is written once; they must
+	// stay valid until the bring-up is done.  Transmitting or Reset()
+	// before then finishes the bring-up first, blocking.
+	//
+	// The radio isn't ready any sooner than with Initialize(): it still
+	// waits MRF_BOOT_OSC_US + MRF_BOOT_TUNE_US, about 5 ms.  What changes is
+	// that loop() runs meanwhile instead of setup() blocking.
+	void Begin(const uint16_t *registers, uint8_t count);
+	uint8_t Startup(void);
+	uint32_t GetStartupTime(void);	// Microseconds from Begin() to receiving
+
+	// Power saving between messages.  Standby() keeps the crystal running
+	// and turns the synthesizer and both chains off; Sleep() turns the
+	// crystal off too.  Both wait for a frame being sent, drop one being
+	// received, and keep every register, so Resume() only turns the
+	// receiver back on; it doesn't wait.  Until the synthesizer has settled
+	// nothing is received: MRF_WAKE_STANDBY_US (250 us) after standby,
+	// MRF_WAKE_SLEEP_US (4.25 ms) after sleep.  Transmitting resumes by
+	// itself and waits out the rest of that time before the preamble, so
+	// wake-to-TX is the same.  Reset() resumes as well.
+	void Standby(void);
+	void Sleep(void);
+	void Resume(void);
+	uint8_t GetPowerState(void);
+
 	boolean IsIdle(void);
 	boolean IsAlive(void);
 	uint16_t ReadStatus(void);
 
 	// After setting registers using this function, it's a good idea to reset the xcvr
 	void SetRegister(uint16_t value);
+	void SetRegisters(const uint16_t *values, uint8_t count);
 
-	// Packet based functions
+	// Packet based functions.  Frames with PACKET_FLAG_ENCRYPTED need a key
+	// (Registers.SetKey()) and a node address (SetAddress()), the address
+	// keeps the nonces of nodes sharing a key apart.  Without either they're
+	// dropped and TX failed is posted.  Received encrypted frames are only delivered once their tag
+	// has been checked; streamed bytes are unauthenticated until COMMIT.
+	//
+	// TransmitPacket() copies the packet into a pool buffer.  The packet
+	// ReceivePacket() returns stays valid until the next call, which gives
+	// its buffer back to the pool.
 	void TransmitPacket(MRF_packet_t *packet);
 	MRF_packet_t* ReceivePacket(void);
 
+	// Zero-copy versions.  ReceiveHandle() hands the next received frame
+	// over to the application (MRF_HANDLE_NONE if there's none), which
+	// either frees it with Pool.Free() or passes it on to TransmitHandle().
+	// TransmitHandle() takes any buffer the application owns, including
+	// one from Pool.Allocate(MRF_OWNER_APP, ...), and frees it once sent.
+	void TransmitHandle(MRF_handle_t handle);
+	MRF_handle_t ReceiveHandle(void);
+
+	// Packets with a smaller capacity share the layout up to the payload
+	template <uint8_t capacity>
+	void TransmitPacket(MRF_packet_storage_t<capacity> *packet)
+	{
+		static_assert(capacity <= MRF_PAYLOAD_LEN, "packet is larger than the driver's buffers");
+
+		TransmitPacket((MRF_packet_t *)packet);
+	}
+
+	// Event driven interface.  The interrupt queues events, and Dispatch()
+	// runs the handlers from loop() (or any other non-interrupt context).
+	// With a receive handler set, Dispatch() takes the frame through
+	// ReceiveHandle() and frees it when the handler returns; without one
+	// frames are left for polling.
+	void OnReceive(MRF_receive_handler_t handler);
+	void OnTransmitDone(MRF_event_handler_t handler);
+	void OnTransmitFailed(MRF_event_handler_t handler);
+	void OnLinkError(MRF_event_handler_t handler);
+	uint8_t Dispatch(void);		// Returns the number of events handled
+
+	// Number of errors of one MRF_ERROR_* class since the last
+	// ClearErrors(), saturating at 0xFFFF.  Counted with or without an
+	// error handler.
+	uint16_t GetErrorCount(uint8_t error);
+	void ClearErrors(void);
+
+	// Cut-through receive.  StreamHeader() returns 1 once the header of a
+	// new frame has arrived, StreamRead() then returns the payload bytes
+	// as they're decoded, and StreamStatus() tells whether the frame was
+	// completed or dropped.  Committed frames are still delivered through
+	// ReceivePacket() and the events; streaming is only an early view.
+	// Frames that were received whole but not queued end up DROPPED.  A
+	// committed frame can be read to the end until its buffer is freed
+	// (by the next ReceivePacket() after the one that returned it, or
+	// Pool.Free()); after that the stream is LOST.  StreamRead() returns
+	// nothing more once the frame is ABORT, DROPPED or LOST.
+	uint8_t StreamHeader(MRF_stream_t *stream);
+	uint8_t StreamRead(MRF_stream_t *stream, uint8_t *data, uint8_t length);
+	uint8_t StreamStatus(MRF_stream_t *stream);
+
+	// Link information (RSSI, DQD, clock lock, AFC offset) of the last frame
+	MRF_frame_info_t GetFrameInfo(void);
+
+	// micros() when the sync word of the last frame sent started going out.
+	// Time sync frames (PACKET_TYPE_TIME) also carry it in their payload,
+	// written by the interrupt just before the payload goes out, see
+	// TimeSync.h.  Both timestamps are taken in the interrupt, a fixed
+	// number of byte periods from the sync word.
+	uint32_t GetTransmitTime(void);
+
+#ifdef MRF_ISR_PROFILE
+	// Worst cases since Begin() or the last ClearIsrProfile(), in CPU
+	// cycles.  The interrupt's entry and exit and the FIFO flag check
+	// aren't included, they're the same for every handler.
+	void GetIsrProfile(MRF_isr_profile_t *profile);
+	void ClearIsrProfile(void);
+#endif
+
+	// Store ECC payloads as the received Hamming symbols (2 per byte) rather
+	// than decoding them, for capturing.  Only frames up to half the maximum
+	// payload length fit.  The payloadSize field still counts decoded bytes.
+	void SetRawReceive(uint8_t enable);
+
+	// Burst mode versions for high data rates.  These mask the IRO interrupt
+	// and poll the FIFO until the frame is sent or received (or the timeout
+	// in milliseconds expires).  Nothing else happens on the radio meanwhile.
+	// Both finish a bring-up in progress and resume from standby or sleep
+	// before masking the interrupt.
+	void TransmitPacketPolled(MRF_packet_t *packet);
+	MRF_packet_t* ReceivePacketPolled(uint16_t timeout);
+
 	void SetBaudrate(uint16_t baud);	// Sets the baud rate in kbps
 	void SetFrequency(uint16_t freqb);  // Setting for the FREQB register
 
+	// Address filtering.  Nodes on different networks use different sync
+	// bytes, so foreign frames are rejected by the transceiver itself.
+	// Addressed frames for other nodes are dropped after the header byte.
+	void SetAddress(uint8_t address);	// MRF_ADDRESS_BROADCAST to accept all
+	uint8_t GetAddress(void);
+	void SetNetwork(uint8_t sync);		// Second sync byte (SYNBREG)
+
+	// Number of extra 0xAA preamble bytes before the sync word (default 1).
+	// The transmit register's reset value adds 2 more.  Shorter preambles
+	// save airtime at high rates; use whitened payloads to keep the clock
+	// recovery locked without a long preamble.
+	void SetPreamble(uint8_t length);
+
+	// Relaying.  Frames sent with PACKET_FLAG_RELAY get the source and a
+	// sequence number stamped by the driver, and a TTL of RELAY_TTL_DEFAULT
+	// unless the hops field already has one.  Every node drops relayed
+	// frames it has already seen.  In repeater mode relayed frames are
+	// also forwarded from the interrupt, with the TTL decremented, and are
+	// only delivered if they're meant for this node.
+	void SetRepeater(uint8_t enable);
+
+	// With a router set the repeater sends forwarded frames to the next hop
+	// it returns instead of flooding them, see Mesh.h.
+	void SetRouter(MRF_router_t router);
+
 	// Testing functions
 	void TransmitZero(void);
 	void TransmitOne(void);
 	void TransmitAlternating(void);
-	void PacketReflect(void);
-	void PacketGenerator(void);
+
+	// Link testing, see LinkTest.h for the measuring side.  In reflect mode
+	// test requests are echoed from the interrupt and never delivered.
+	// The generator sends one test request of the given size and type.
+	void PacketReflect(uint8_t enable);
+	void PacketGenerator(uint8_t size, uint8_t type, uint16_t sequence);
+
 	void Reset(void);
 };
 
 extern MRF49XA_t MRF49XA;
 
+#include "Pool.h"
+
 #endif
\ No newline at end of file
@@ -228,6 +228,8 @@
 // Center Frequency Value Set Register
 #define MRF_CFSREG		0xA000		// Center Frequency value register address
 #define MRF_FREQB_MASK	0x0FFF		// Center Frequency value (see datasheet)
+#define MRF_FREQB_MIN	97
+#define MRF_FREQB_MAX	3903
 
 // Frequency setting for 432.10 mHz
 #define MRF_FREQB		840
@@ -377,6 +379,39 @@
 // These are macros for setting up the interrupts for the MRF
 #define MRF_INT_SETUP()	EICRA |= (1 << ISC11)
 #define MRF_INT_MASK()	EIMSK |= (1 << INT1)
+#define MRF_INT_DISABLE()	EIMSK &= ~(1 << INT1)
+
+// Free running timer for trace timestamps.  Timer 1 runs with the /64
+// prescaler (4 us per tick at 16 MHz) and wraps every 262 ms.  This takes
+// the timer away from analogWrite() on its PWM pins.
+#define MRF_TIMER_SETUP()	do { TCCR1A = 0; TCCR1B = (1 << CS11) | (1 << CS10); } while (0)
+#define MRF_TIMER_READ()	TCNT1
+#define MRF_TIMER_US		4
+
+// Uncomment to time the FIFO interrupt handlers, see GetIsrProfile().
+// Timer 1 is switched to the CPU clock instead, so this can't be combined
+// with MRF_TRACE.
+//#define MRF_ISR_PROFILE
+#define MRF_PROFILE_TIMER_SETUP()	do { TCCR1A = 0; TCCR1B = (1 << CS10); } while (0)
+
+// Uncomment to use one payload handler per direction that tests the frame
+// flags on every byte, instead of one per combination picked from the
+// header.  Only there to compare the two with MRF_ISR_PROFILE.
+//#define MRF_ISR_GENERIC
+
+// Bring-up timing, see MRF49XA.Begin().  The crystal is started first and
+// given MRF_BOOT_OSC_US; the transmitter then runs for MRF_BOOT_TUNE_US so
+// the antenna is tuned at the programmed frequency.  These are fixed
+// allowances, the same 5 ms the old blocking delay gave: STSREG has no bit
+// that says the crystal has started or the tuning is done.
+#define MRF_BOOT_OSC_US		4000
+#define MRF_BOOT_TUNE_US	1000
+
+// Wake-up latency, see MRF49XA.Resume().  With the crystal running the
+// synthesizer starts in about 250 us; from sleep the crystal needs the
+// same allowance as at bring-up first.
+#define MRF_WAKE_STANDBY_US	250
+#define MRF_WAKE_SLEEP_US	(MRF_BOOT_OSC_US + MRF_WAKE_STANDBY_US)
 
 /*******************************************************************************
  * These defines set either the soldered-on characteristics of the MRF module,
@@ -386,8 +421,10 @@
  ******************************************************************************/
 // Set the module to 434 Mhz band, with 10pF series capactance crystal
 #define MRF_GENCREG_SET		(MRF_GENCREG | (MRF_LCS & MRF_LCS_MASK) | MRF_FBS_434)
-#define MRF_AFCCREG_SET		(MRF_AFCCREG | MRF_AUTOMS_INDP | MRF_ARFO_3to4 | MRF_HAM | MRF_FOFEN) // defaults
+// Measure the offset all the time, and add it to the synthesizer (FOREN)
+#define MRF_AFCCREG_SET		(MRF_AFCCREG | MRF_AUTOMS_INDP | MRF_ARFO_3to4 | MRF_HAM | MRF_FOREN | MRF_FOFEN)
 #define MRF_PLLCREG_SET		(MRF_PLLCREG | MRF_CBTC_5p)
+#define MRF_PMCREG_SET		(MRF_PMCREG | MRF_CLKODIS)	// Chains are added to this
 #define MRF_FIFOSTREG_SET	(MRF_FIFORSTREG | MRF_DRSTM | ((8 << 4) & MRF_FFBC_MASK))
 
 #endif
\ No newline at end of file
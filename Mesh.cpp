@@ -0,0 +1,241 @@
+/*
+ *  Mesh.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "Mesh.h"
+#include "MRF49XA.h"
+#include "MRF49XA_definitions.h"
+
+Mesh_t Mesh = Mesh_t();
+
+static uint8_t RouteLookup(uint8_t target)
+{
+	return Mesh.NextHop(target);
+}
+
+void Mesh_t::Begin(uint16_t interval)
+{
+	count = 0;
+
+	this->interval = interval;
+	lastBeacon = millis() - interval;
+
+	MRF49XA.SetRouter(RouteLookup);
+	MRF49XA.SetRepeater(1);
+}
+
+// Called from the interrupt as well, the table is only changed with
+// interrupts disabled.
+uint8_t Mesh_t::NextHop(uint8_t target)
+{
+	for (uint8_t i = 0; i < count; i++) 
+	{
+		if (routes[i].target == target) return routes[i].nextHop;
+	}
+
+	return MRF_ADDRESS_BROADCAST;
+}
+
+uint8_t Mesh_t::GetRoute(uint8_t index, MRF_route_t *route)
+{
+	if (index >= count) return 0;
+
+	noInterrupts();
+	*route = routes[index];
+	interrupts();
+
+	return 1;
+}
+
+void Mesh_t::Send(uint8_t target, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+	MRF_packet_t packet;
+
+	if (length > MRF_PAYLOAD_LEN) length = MRF_PAYLOAD_LEN;
+
+	packet.payloadSize = length;
+	packet.type        = (type & PACKET_TYPE_MASK) | PACKET_FLAG_RELAY | PACKET_FLAG_ADDRESSED;
+	packet.address     = NextHop(target);
+	packet.target      = target;
+	packet.hops        = RELAY_HOPS_TTL(0, MESH_TTL);
+
+	memcpy(packet.payload, payload, length);
+
+	MRF49XA.TransmitPacket(&packet);
+}
+
+void Mesh_t::Service(void)
+{
+	if ((uint32_t)(millis() - lastBeacon) < interval) return;
+
+	// Don't queue up behind a frame in progress, try again next time
+	if (!MRF49XA.IsIdle()) return;
+
+	lastBeacon = millis();
+
+	// Age the routes, and drop the ones nobody has advertised for a while
+	noInterrupts();
+
+	for (uint8_t i = 0; i < count; ) 
+	{
+		if (++routes[i].age > MESH_ROUTE_LIFETIME) routes[i] = routes[--count];
+		else i++;
+	}
+
+	interrupts();
+
+	SendBeacon();
+}
+
+void Mesh_t::SendBeacon(void)
+{
+	MRF_packet_t packet;
+	uint8_t length = 0;
+	uint8_t entries = (count < MESH_BEACON_ROUTES) ? count : MESH_BEACON_ROUTES;
+
+	if (MRF_PAYLOAD_LEN < ROUTE_ENTRY_LEN) return;
+
+	packet.type    = PACKET_TYPE_ROUTE;
+	packet.address = MRF_ADDRESS_BROADCAST;
+
+	// Ourselves first
+	packet.payload[length++] = MRF49XA.GetAddress();
+	packet.payload[length++] = 0;
+
+	for (uint8_t i = 0; i < entries; i++) 
+	{
+		packet.payload[length++] = routes[i].target;
+		packet.payload[length++] = routes[i].metric;
+	}
+
+	packet.payloadSize = length;
+
+	MRF49XA.TransmitPacket(&packet);
+}
+
+// The link quality is what the radio reported while the beacon was received
+static uint8_t LinkCost(MRF_frame_info_t info)
+{
+	uint16_t cost = MESH_COST_HOP + info.corrections;
+
+	if (!(info.status & MRF_ATTRSSI)) cost += MESH_COST_RSSI;
+	if (!(info.status & MRF_DQDO))    cost += MESH_COST_DQD;
+	if (!(info.status & MRF_CLKRL))   cost += MESH_COST_CLOCK;
+
+	if (cost > MESH_METRIC_MAX) cost = MESH_METRIC_MAX;
+
+	return cost;
+}
+
+uint8_t Mesh_t::PacketReceived(MRF_packet_t *packet)
+{
+	uint8_t kind = packet->type & PACKET_TYPE_MASK;
+
+	if (kind != PACKET_TYPE_ROUTE && kind != PACKET_TYPE_ROUTE_ECC) return 0;
+	if (packet->payloadSize < ROUTE_ENTRY_LEN) return 1;
+
+	uint8_t neighbour = packet->payload[ROUTE_OFFSET_TARGET];
+	uint8_t cost = LinkCost(MRF49XA.GetFrameInfo());
+	uint8_t self = MRF49XA.GetAddress();
+
+	for (uint8_t i = 0; i + ROUTE_ENTRY_LEN <= packet->payloadSize; i += ROUTE_ENTRY_LEN) 
+	{
+		uint8_t target = packet->payload[i + ROUTE_OFFSET_TARGET];
+		uint16_t metric = packet->payload[i + ROUTE_OFFSET_METRIC];
+
+		if (target == self || target == MRF_ADDRESS_BROADCAST) continue;
+
+		metric += cost;
+		if (metric > MESH_METRIC_MAX) metric = ROUTE_METRIC_INFINITE;
+
+		Update(target, neighbour, metric);
+	}
+
+	return 1;
+}
+
+// Distance-vector update: take a cheaper route, and always follow what the
+// current next hop says (even if it got worse)
+void Mesh_t::Update(uint8_t target, uint8_t nextHop, uint8_t metric)
+{
+	uint8_t i;
+
+	for (i = 0; i < count; i++) 
+	{
+		if (routes[i].target == target) break;
+	}
+
+	noInterrupts();
+
+	if (i < count) 
+	{
+		if (routes[i].nextHop == nextHop || metric < routes[i].metric) 
+		{
+			if (metric == ROUTE_METRIC_INFINITE) 
+			{
+				routes[i] = routes[--count];
+			}
+			else 
+			{
+				routes[i].nextHop = nextHop;
+				routes[i].metric  = metric;
+				routes[i].age     = 0;
+			}
+		}
+	}
+	else if (metric != ROUTE_METRIC_INFINITE) 
+	{
+		// When the table is full, a new route replaces the most expensive one
+		if (count == MESH_ROUTES) 
+		{
+			uint8_t worst = 0;
+
+			for (i = 1; i < count; i++) 
+			{
+				if (routes[i].metric > routes[worst].metric) worst = i;
+			}
+
+			if (routes[worst].metric > metric) i = worst;
+		}
+		else 
+		{
+			i = count++;
+		}
+
+		if (i < MESH_ROUTES) 
+		{
+			routes[i].target  = target;
+			routes[i].nextHop = nextHop;
+			routes[i].metric  = metric;
+			routes[i].age     = 0;
+		}
+	}
+
+	interrupts();
+}
+
+const char routeHeaderString[] PROGMEM = "\n\rTarget NextHop Metric Age";
+
+void Mesh_t::Report(Print &out)
+{
+	MRF_route_t route;
+
+	out.print(routeHeaderString);
+
+	for (uint8_t i = 0; GetRoute(i, &route); i++) 
+	{
+		out.print("\n\r");
+		out.print(route.target, DEC);
+		out.print(' ');
+		out.print(route.nextHop, DEC);
+		out.print(' ');
+		out.print(route.metric, DEC);
+		out.print(' ');
+		out.print(route.age, DEC);
+	}
+}
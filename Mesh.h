@@ -0,0 +1,92 @@
+/*
+ *  Mesh.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Number of destinations the route table holds.  Each entry takes 4 bytes
+// of SRAM and 2 bytes of every beacon.
+#define MESH_ROUTES          8
+
+// Routes a beacon has room for after the sender's own entry.  With a small
+// MRF_PAYLOAD_LEN the rest of the table isn't advertised, and below one
+// entry no beacons are sent at all.
+#if MRF_PAYLOAD_LEN < 2 * ROUTE_ENTRY_LEN
+#define MESH_BEACON_ROUTES   0
+#elif (MRF_PAYLOAD_LEN / ROUTE_ENTRY_LEN - 1) < MESH_ROUTES
+#define MESH_BEACON_ROUTES   (MRF_PAYLOAD_LEN / ROUTE_ENTRY_LEN - 1)
+#else
+#define MESH_BEACON_ROUTES   MESH_ROUTES
+#endif
+
+// Hops a routed frame may take
+#define MESH_TTL             5
+
+// Routes not refreshed by a beacon for this many beacon intervals expire
+#define MESH_ROUTE_LIFETIME  4
+
+// Metrics above this count as unreachable, which bounds count-to-infinity
+#define MESH_METRIC_MAX      64
+
+// Link cost of one hop.  Each quality bit of STSREG that was clear when
+// the beacon arrived adds its penalty, and so does each Hamming correction.
+#define MESH_COST_HOP        4
+#define MESH_COST_RSSI       4		// Signal below the RSSI threshold
+#define MESH_COST_DQD        4		// Data quality detector not satisfied
+#define MESH_COST_CLOCK      2		// Clock recovery not locked
+
+typedef struct {
+	uint8_t target;
+	uint8_t nextHop;
+	uint8_t metric;
+	uint8_t age;			// Beacon intervals since the last refresh
+} MRF_route_t;
+
+// Distance-vector routing over the relay header.  Every node broadcasts its
+// route table to its neighbours, and keeps the cheapest next hop for every
+// destination.  Routed frames are addressed to the next hop, so only that
+// node forwards them; the repeater does this from the interrupt, looking up
+// the table through MRF49XA.SetRouter().  Destinations without a route are
+// flooded.
+class Mesh_t
+{
+public:
+	// The node address must be set (MRF49XA.SetAddress()) first.  Enables
+	// the repeater.  interval is the beacon period in milliseconds.
+	void Begin(uint16_t interval);
+
+	// Sends payload to target over the mesh.  type is the payload type,
+	// the relay and address flags are added.
+	void Send(uint8_t target, uint8_t type, const uint8_t *payload, uint8_t length);
+
+	// Call from loop(), sends the beacon and ages the routes when due
+	void Service(void);
+
+	// Hand every received packet to this.  Returns 1 if it was a beacon
+	// and was consumed.
+	uint8_t PacketReceived(MRF_packet_t *packet);
+
+	uint8_t NextHop(uint8_t target);	// MRF_ADDRESS_BROADCAST if unknown
+	uint8_t GetRoute(uint8_t index, MRF_route_t *route);
+	void Report(Print &out);
+private:
+	void Update(uint8_t target, uint8_t nextHop, uint8_t metric);
+	void SendBeacon(void);
+
+	MRF_route_t routes[MESH_ROUTES];
+	uint8_t count;
+	uint16_t interval;
+	uint32_t lastBeacon;
+};
+
+extern Mesh_t Mesh;
+
+#endif
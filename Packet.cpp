@@ -16,35 +16,45 @@
 
 Packet_t Packet = Packet_t();
 
-void Packet_t::ByteReceived(uint8_t data, volatile uint8_t &counter, volatile enum device_mode &mode, volatile MRF_packet_t &packet)
+void Packet_t::ByteReceived(uint8_t data, volatile MRF_counter_t &counter, volatile enum device_mode &mode)
 {
+	MRF_packet_t *packet = (handle == MRF_HANDLE_NONE) ? NULL : Pool.Get(handle);
+
 	// Fill out the packet contents
 	switch (counter) {
 		case 0:
 			// Sanity checking on the length byte
 			if (data <= MRF_PAYLOAD_LEN) 
 			{
-				packet.payloadSize = data;
+				if (handle == MRF_HANDLE_NONE) handle = Pool.Allocate(MRF_OWNER_APP, 0);
+
+				length = data;
 				counter++;
 			}
 
 			break;
 		case 1:
-			if (mode == MODE_SERIAL_ECC) packet.type = PACKET_TYPE_SERIAL_ECC;
-			else packet.type = PACKET_TYPE_SERIAL;
-			
+			if (packet != NULL)
+			{
+				packet->payloadSize = length;
+				if (mode == MODE_SERIAL_ECC) packet->type = PACKET_TYPE_SERIAL_ECC;
+				else packet->type = PACKET_TYPE_SERIAL;
+			}
+
 			counter++;
 			break;
 		default:
-			packet.payload[counter - 2] = data;
+			if (packet != NULL) packet->payload[counter - 2] = data;
 			counter++;
 			break;
 	}
 	
 	// If the counter equals the packet size, transmit
-	if (counter >= packet.payloadSize + MRF_PACKET_OVERHEAD) {
-		// Disable new serial data during this routine
-		MRF49XA.TransmitPacket((MRF_packet_t *)(&packet));
+	if (counter >= length + MRF_PACKET_OVERHEAD) {
+		// The driver frees the buffer once it's sent
+		if (handle != MRF_HANDLE_NONE) MRF49XA.TransmitHandle(handle);
+
+		handle = MRF_HANDLE_NONE;
 		counter = 0;
 	}
-}
\ No newline at end of file
+}
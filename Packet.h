@@ -13,12 +13,23 @@
 #define PACKET_H
 
 #include "MRF49XA.h"
+#include "Pool.h"
 #include "Modes.h"
 
+// Assembles frames typed into the serial port: length, then type, then the
+// payload.  The frame is built in a pool buffer (see Pool.h), taken at the
+// length byte and handed to the driver once complete.  If the pool is
+// empty the frame's bytes are still counted, but it isn't sent.
 class Packet_t
 {
 public:
-	void ByteReceived(uint8_t data, volatile uint8_t &counter, volatile enum device_mode &mode, volatile MRF_packet_t &packet);
+	Packet_t() : handle(MRF_HANDLE_NONE) { }
+
+	void ByteReceived(uint8_t data, volatile MRF_counter_t &counter, volatile enum device_mode &mode);
+
+private:
+	MRF_handle_t handle;
+	uint8_t length;
 };
 
 extern Packet_t Packet;
@@ -0,0 +1,110 @@
+/*
+ *  PacketTypes.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Values of the packet type byte and header fields.  This only depends on
+ *  stdint so host-side tools can decode frames with the same definitions.
+ *
+ */
+
+#ifndef PACKET_TYPES_H
+#define PACKET_TYPES_H
+
+#include <stdint.h>
+
+#define PACKET_TYPE_SERIAL     0x01
+#define PACKET_TYPE_SERIAL_ECC 0x02
+#define PACKET_TYPE_PACKET     0x03
+#define PACKET_TYPE_PACKET_ECC 0x04
+#define PACKET_TYPE_TEST       0x05	// Link test frames, see LinkTest.h
+#define PACKET_TYPE_TEST_ECC   0x06
+#define PACKET_TYPE_ROUTE      0x07	// Mesh route beacons, see Mesh.h
+#define PACKET_TYPE_ROUTE_ECC  0x08
+#define PACKET_TYPE_BATCH      0x09	// Several messages per frame, see Aggregate.h
+#define PACKET_TYPE_BATCH_ECC  0x0A
+#define PACKET_TYPE_TIME       0x0B	// Time synchronization, see TimeSync.h
+#define PACKET_TYPE_TIME_ECC   0x0C
+
+// Types come in pairs, the even member of each pair is Hamming coded
+#define PACKET_TYPE_IS_ECC(t)  ((((t) & PACKET_TYPE_MASK) != 0) && !((t) & 0x01))
+
+// The upper bits of the type field are flags describing optional header
+// fields that follow the type byte over the air.  Mask them off with
+// PACKET_TYPE_MASK to get the payload type.
+#define PACKET_TYPE_MASK       0x0F
+#define PACKET_FLAG_ADDRESSED  0x80	// A destination address byte follows the type
+#define PACKET_FLAG_WHITENED   0x40	// The payload is whitened with PN9
+#define PACKET_FLAG_RELAY      0x20	// A relay header follows the address
+#define PACKET_FLAG_ENCRYPTED  0x10	// Nonce after the headers, tag after the payload
+
+// Initial state of the PN9 whitening generator
+#define MRF_WHITENING_SEED     0x01FF
+
+// Frames addressed to MRF_ADDRESS_BROADCAST are accepted by every node.
+// A node whose own address is MRF_ADDRESS_BROADCAST accepts every frame.
+#define MRF_ADDRESS_BROADCAST  0xFF
+
+// Relay header, sent after the address byte (if any).  The source and
+// sequence identify the frame for duplicate suppression, the target is the
+// final destination.  The last byte holds the hops taken so far in the
+// high nibble and the hops left (TTL) in the low nibble.
+#define RELAY_OFFSET_SOURCE      0
+#define RELAY_OFFSET_TARGET      1
+#define RELAY_OFFSET_SEQUENCE    2
+#define RELAY_OFFSET_HOPS        3
+#define RELAY_HEADER_LEN         4
+
+#define RELAY_HOPS(h)            ((h) >> 4)
+#define RELAY_TTL(h)             ((h) & 0x0F)
+#define RELAY_HOPS_TTL(hops, ttl) ((uint8_t)(((hops) << 4) | ((ttl) & 0x0F)))
+
+#define RELAY_TTL_DEFAULT        3
+
+// Encrypted frames (see Crypto.h) carry a nonce after the other header
+// fields and an authentication tag after the payload.  Neither is Hamming
+// coded or whitened.  payloadSize doesn't include them.
+#define CRYPTO_NONCE_LEN         6
+#define CRYPTO_TAG_LEN           4
+
+// Route beacons (PACKET_TYPE_ROUTE) are sent to the neighbours only, not
+// relayed.  The payload is a list of (target, metric) pairs, starting with
+// the sender itself at metric 0.
+#define ROUTE_ENTRY_LEN          2
+#define ROUTE_OFFSET_TARGET      0
+#define ROUTE_OFFSET_METRIC      1
+
+#define ROUTE_METRIC_INFINITE    0xFF
+
+// Batch frames (PACKET_TYPE_BATCH) carry a list of messages, each one
+// preceded by a length byte.  A zero length ends the list early.
+#define BATCH_HEADER_LEN         1
+
+// Link test frames (PACKET_TYPE_TEST) start with this header, the rest of
+// the payload is fill.  Requests are echoed by a node in reflect mode.
+#define LINKTEST_OFFSET_KIND     0
+#define LINKTEST_OFFSET_SEQUENCE 1	// uint16_t
+#define LINKTEST_OFFSET_TIME     3	// uint32_t, micros() at the sender
+#define LINKTEST_HEADER_LEN      7
+
+#define LINKTEST_REQUEST         0x01
+#define LINKTEST_ECHO            0x02
+
+// Time sync frames (PACKET_TYPE_TIME).  The driver writes the sent time
+// itself, when the sync word goes out.  A response copies the sent time of
+// the request and adds when its sync word was received.  Times are
+// micros() of the node that took them, least significant byte first.
+#define TIMESYNC_OFFSET_KIND     0
+#define TIMESYNC_OFFSET_SEQUENCE 1
+#define TIMESYNC_OFFSET_SOURCE   2	// Address to answer to
+#define TIMESYNC_OFFSET_SENT     3	// uint32_t, written by the driver
+#define TIMESYNC_OFFSET_ORIGIN   7	// uint32_t, sent time of the request
+#define TIMESYNC_OFFSET_RECEIVED 11	// uint32_t, the request arrived
+#define TIMESYNC_REQUEST_LEN     7
+#define TIMESYNC_RESPONSE_LEN    15
+
+#define TIMESYNC_REQUEST         0x01
+#define TIMESYNC_RESPONSE        0x02
+
+#endif
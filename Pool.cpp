@@ -0,0 +1,107 @@
+/*
+ *  Pool.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include "Pool.h"
+
+Pool_t Pool = Pool_t();
+
+void Pool_t::Begin(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	for (uint8_t i = 0; i < MRF_POOL_LEN; i++) 
+	{
+		owners[i] = MRF_OWNER_FREE;
+		freeList[i] = i;
+	}
+
+	freeCount = MRF_POOL_LEN;
+	lowWater = MRF_POOL_LEN;
+
+	SREG = sreg;
+}
+
+// The free list is a stack, so both ends are O(1).  The interrupt and the
+// application both allocate and free, each change is made with the
+// interrupt held off for a few cycles.
+MRF_handle_t Pool_t::Allocate(uint8_t owner, uint8_t keep)
+{
+	MRF_handle_t handle = MRF_HANDLE_NONE;
+
+	uint8_t sreg = SREG;
+	cli();
+
+	if (freeCount > keep) 
+	{
+		handle = freeList[--freeCount];
+		owners[handle] = owner;
+
+		if (freeCount < lowWater) lowWater = freeCount;
+	}
+
+	SREG = sreg;
+
+	return handle;
+}
+
+void Pool_t::Free(MRF_handle_t handle)
+{
+	if (handle >= MRF_POOL_LEN) return;
+
+	uint8_t sreg = SREG;
+	cli();
+
+	// A second free would put the buffer on the list twice
+	if (owners[handle] != MRF_OWNER_FREE) 
+	{
+		owners[handle] = MRF_OWNER_FREE;
+		generations[handle]++;
+		freeList[freeCount++] = handle;
+	}
+
+	SREG = sreg;
+}
+
+void Pool_t::Give(MRF_handle_t handle, uint8_t owner)
+{
+	if (handle >= MRF_POOL_LEN || owners[handle] == MRF_OWNER_FREE) return;
+
+	owners[handle] = owner;
+}
+
+uint8_t Pool_t::Owner(MRF_handle_t handle)
+{
+	if (handle >= MRF_POOL_LEN) return MRF_OWNER_FREE;
+
+	return owners[handle];
+}
+
+uint8_t Pool_t::Generation(MRF_handle_t handle)
+{
+	if (handle >= MRF_POOL_LEN) return 0;
+
+	return generations[handle];
+}
+
+MRF_packet_t *Pool_t::Get(MRF_handle_t handle)
+{
+	if (handle >= MRF_POOL_LEN) return 0;
+
+	return &packets[handle];
+}
+
+uint8_t Pool_t::Available(void)
+{
+	return freeCount;
+}
+
+uint8_t Pool_t::LowWater(void)
+{
+	return lowWater;
+}
@@ -0,0 +1,76 @@
+/*
+ *  Pool.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Every packet buffer of the driver comes from this pool: the one being
+// received into, frames waiting to be read, the frame being sent, and any
+// the application takes for itself.  A handle passes ownership from one
+// to the next, the packet is never copied on the way.
+//
+// Like MRF_PAYLOAD_LEN, set it here or as a compiler flag for the whole
+// build.  The driver holds one buffer for receiving and keeps one back
+// for transmitting, and ReceivePacket() holds the last packet it returned
+// until the next call; the rest queue received frames.  With 3 there's no
+// room left to queue anything while the sketch holds a packet, so frames
+// that arrive then are dropped.  The default of 4 queues one; raise it if
+// frames arrive faster than loop() takes them.
+#ifndef MRF_POOL_LEN
+#define MRF_POOL_LEN 4
+#endif
+
+#if MRF_POOL_LEN < 3 || MRF_POOL_LEN > 32
+#error "MRF_POOL_LEN must be between 3 and 32"
+#endif
+
+// Owners, for debugging and for catching a handle freed twice
+#define MRF_OWNER_FREE	0x00
+#define MRF_OWNER_RX	0x01	// The interrupt, receiving or queued
+#define MRF_OWNER_APP	0x02
+#define MRF_OWNER_TX	0x03	// The interrupt, sending
+
+class Pool_t
+{
+public:
+	void Begin(void);
+
+	// Takes a buffer, unless no more than keep are left.  The interrupt
+	// uses keep to leave a buffer for the transmitter.  Returns
+	// MRF_HANDLE_NONE if there's none.
+	MRF_handle_t Allocate(uint8_t owner, uint8_t keep);
+	void Free(MRF_handle_t handle);
+
+	// Hands a buffer over to a new owner
+	void Give(MRF_handle_t handle, uint8_t owner);
+	uint8_t Owner(MRF_handle_t handle);
+
+	// Changes every time the buffer is freed, so a reader can tell whether
+	// it still holds the same contents
+	uint8_t Generation(MRF_handle_t handle);
+
+	MRF_packet_t *Get(MRF_handle_t handle);
+
+	uint8_t Available(void);
+	uint8_t LowWater(void);		// Fewest buffers left since Begin()
+
+private:
+	MRF_packet_t packets[MRF_POOL_LEN];
+	uint8_t owners[MRF_POOL_LEN];
+	volatile uint8_t generations[MRF_POOL_LEN];
+	uint8_t freeList[MRF_POOL_LEN];
+	volatile uint8_t freeCount;
+	uint8_t lowWater;
+};
+
+extern Pool_t Pool;
+
+#endif
@@ -13,22 +13,165 @@
 #include <EEPROM.h>
 #include "Registers.h"
 #include "MRF49XA.h"
-#include "Hamming.h"
 #include "Modes.h"
+#include "Crc.h"
 
 Registers_t Registers = Registers_t();
 
+static const uint16_t defaultRegisters[MRF_REG_COUNT] PROGMEM = {
+	0xC4F7,		// AFCREG
+	0x9810,		// TXCREG
+	0xA348,		// CFSREG
+	0x94C0,		// RXCREG
+	0xC2AC,		// BBFCREG
+	0xCA81,		// FIFORSTREG
+	0xCED4,		// SYNBREG
+	0xC623,		// DRSREG
+	0xCC77		// PLLCREG
+};
+
+static inline uint16_t SlotAddress(uint8_t slot)
+{
+	return MRF_CONFIG_BASE + slot * sizeof(MRF_config_t);
+}
+
+static inline uint8_t ConfigCrc(const MRF_config_t &config)
+{
+	return Crc8((const uint8_t *)&config, offsetof(MRF_config_t, crc));
+}
+
 void Registers_t::ApplySavedRegisters(void)
 {
-	MRF49XA.SetRegister(EEPROM.read(afcreg));
-    MRF49XA.SetRegister(EEPROM.read(txcreg));
-    MRF49XA.SetRegister(EEPROM.read(cfsreg));
-    MRF49XA.SetRegister(EEPROM.read(rxcreg));
-    MRF49XA.SetRegister(EEPROM.read(bbfcreg));
-    MRF49XA.SetRegister(EEPROM.read(fiforstreg));
-    MRF49XA.SetRegister(EEPROM.read(synbreg));
-    MRF49XA.SetRegister(EEPROM.read(drsreg));
-    MRF49XA.SetRegister(EEPROM.read(pllcreg));
+	Load();
+
+	profile = config.bootProfile;
+	memcpy(applied, config.profiles[profile].registers, sizeof(applied));
+
+	// The whole set goes out back-to-back, reset the transceiver afterwards
+	MRF49XA.SetRegisters(applied, MRF_REG_COUNT);
+
+	ApplyKey();
+}
+
+void Registers_t::Begin(void)
+{
+	Load();
+
+	profile = config.bootProfile;
+	memcpy(applied, config.profiles[profile].registers, sizeof(applied));
+
+	// The driver reads them from applied[] while it starts
+	MRF49XA.Begin(applied, MRF_REG_COUNT);
+
+	ApplyKey();
+}
+
+void Registers_t::SetKey(const uint8_t *key)
+{
+	Load();
+
+	if (key) memcpy(config.key, key, CRYPTO_KEY_LEN);
+	else memset(config.key, 0, CRYPTO_KEY_LEN);
+
+	Save();
+	ApplyKey();
+}
+
+static uint16_t ReserveEpoch(void)
+{
+	return Registers.NextEpoch();
+}
+
+uint16_t Registers_t::NextEpoch(void)
+{
+	Load();
+
+	config.epoch++;
+	Save();
+
+	return config.epoch;
+}
+
+// Nothing is written here, so the bring-up doesn't wait for the EEPROM:
+// the epoch is only advanced when the first encrypted frame needs a nonce
+void Registers_t::ApplyKey(void)
+{
+	uint8_t set = 0;
+
+	for (uint8_t i = 0; i < CRYPTO_KEY_LEN; i++) set |= config.key[i];
+
+	Crypto.SetKey(set ? config.key : NULL, ReserveEpoch);
+}
+
+void Registers_t::ApplyProfile(uint8_t index)
+{
+	if (index >= MRF_PROFILE_COUNT) return;
+
+	Load();
+
+	const uint16_t *registers = config.profiles[index].registers;
+
+	for (uint8_t i = 0; i < MRF_REG_COUNT; i++)
+	{
+		if (applied[i] == registers[i]) continue;
+
+		applied[i] = registers[i];
+		MRF49XA.SetRegister(registers[i]);
+	}
+
+	profile = index;
+
+	MRF49XA.Reset();
+}
+
+uint8_t Registers_t::FindProfile(const char *name)
+{
+	Load();
+
+	for (uint8_t i = 0; i < MRF_PROFILE_COUNT; i++)
+	{
+		if (strncmp(config.profiles[i].name, name, MRF_PROFILE_NAME_LEN) == 0) return i;
+	}
+
+	return MRF_PROFILE_NONE;
+}
+
+uint8_t Registers_t::GetProfile(void)
+{
+	return profile;
+}
+
+void Registers_t::SetProfile(uint8_t index, const char *name, const uint16_t *registers)
+{
+	if (index >= MRF_PROFILE_COUNT) return;
+
+	Load();
+
+	MRF_profile_t &stored = config.profiles[index];
+
+	strncpy(stored.name, name, MRF_PROFILE_NAME_LEN);
+
+	for (uint8_t i = 0; i < MRF_REG_COUNT; i++)
+	{
+		stored.registers[i] = registers[i];
+	}
+
+	// RXCREG bit FINTDIO must be set
+	stored.registers[MRF_REG_RXCREG] |= MRF_FINTDIO;
+
+	Save();
+}
+
+void Registers_t::SetBootProfile(uint8_t index)
+{
+	if (index >= MRF_PROFILE_COUNT) return;
+
+	Load();
+
+	if (config.bootProfile == index) return;
+
+	config.bootProfile = index;
+	Save();
 }
 
 const char afcregString[]     PROGMEM = "\n\r0) AFCREG:     ";
@@ -43,106 +186,157 @@ const char pllcregString[]    PROGMEM = "\n\r8) PLLCREG:    ";
 
 void Registers_t::PrintSavedRegisters(void)
 {
+	Load();
+
+	const uint16_t *registers = config.profiles[config.bootProfile].registers;
+
 	if (Serial)
 	{
 		Serial.print(afcregString);
-    	Serial.print(afcreg, HEX);
+    	Serial.print(registers[MRF_REG_AFCREG], HEX);
     	Serial.print(txcregString);
-    	Serial.print(txcreg, HEX);
+    	Serial.print(registers[MRF_REG_TXCREG], HEX);
     	Serial.print(cfsregString);
-    	Serial.print(cfsreg, HEX);
+    	Serial.print(registers[MRF_REG_CFSREG], HEX);
     	Serial.print(rxcregString);
-    	Serial.print(rxcreg, HEX);
+    	Serial.print(registers[MRF_REG_RXCREG], HEX);
     	Serial.print(bbfcregString);
-    	Serial.print(bbfcreg, HEX);
+    	Serial.print(registers[MRF_REG_BBFCREG], HEX);
     	Serial.print(fiforstregString);
-    	Serial.print(fiforstreg, HEX);
+    	Serial.print(registers[MRF_REG_FIFORSTREG], HEX);
     	Serial.print(synbregString);
-    	Serial.print(synbreg, HEX);
+    	Serial.print(registers[MRF_REG_SYNBREG], HEX);
     	Serial.print(drsregString);
-    	Serial.print(drsreg, HEX);
+    	Serial.print(registers[MRF_REG_DRSREG], HEX);
     	Serial.print(pllcregString);
-    	Serial.print(pllcreg, HEX);
+    	Serial.print(registers[MRF_REG_PLLCREG], HEX);
 	}
 }
 
 void Registers_t::SetRegisterValue(uint8_t index, uint16_t value)
 {
-	switch (index) {
-        case 0:
-            EEPROM.write(afcreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 1:
-            EEPROM.write(txcreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 2:
-            EEPROM.write(cfsreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 3:
-            // RXCREG bit FINTDIO must be set
-            EEPROM.write(rxcreg, value | MRF_FINTDIO);
-            MRF49XA.SetRegister(value | MRF_FINTDIO);
-            break;
-        case 4:
-            EEPROM.write(bbfcreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 5:
-            EEPROM.write(fiforstreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 6:
-            EEPROM.write(synbreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 7:
-            EEPROM.write(drsreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        case 8:
-            EEPROM.write(pllcreg, value);
-            MRF49XA.SetRegister(value);
-            break;
-        default:
-            return;
-    }
+	if (index >= MRF_REG_COUNT) return;
+
+	// RXCREG bit FINTDIO must be set
+	if (index == MRF_REG_RXCREG) value |= MRF_FINTDIO;
+
+	Load();
+
+	uint16_t *registers = config.profiles[config.bootProfile].registers;
+
+	if (registers[index] != value)
+	{
+		registers[index] = value;
+		Save();
+	}
+
+	// Only mirror the change if the boot profile is the one in use
+	if (profile != config.bootProfile) return;
+
+	applied[index] = value;
+	MRF49XA.SetRegister(value);
     
     // The transciever should be reset after register setting
     MRF49XA.Reset();
 }
 
+void Registers_t::ApplyRegisterValue(uint8_t index, uint16_t value)
+{
+	if (index >= MRF_REG_COUNT) return;
+
+	// RXCREG bit FINTDIO must be set
+	if (index == MRF_REG_RXCREG) value |= MRF_FINTDIO;
+
+	if (applied[index] == value) return;
+
+	applied[index] = value;
+	MRF49XA.SetRegister(value);
+}
+
 enum device_mode Registers_t::GetBootState(void)
 {
-	uint8_t mode = Hamming.DecodeByte(EEPROM.read(bootMode));
+	Load();
 
-    switch(mode) {
+    switch(config.bootMode) {
         case MODE_SERIAL:
         case MODE_SERIAL_ECC:
-            return (enum device_mode)mode;
+            return (enum device_mode)config.bootMode;
         default:
-            SetEEPROMDefaults();
             return MODE_SERIAL;
     }
 }
 
 void Registers_t::SetBootState(enum device_mode mode)
 {
-	EEPROM.write(bootMode, Hamming.EncodeByte((uint8_t)mode));
+	Load();
+
+	if (config.bootMode == (uint8_t)mode) return;
+
+	config.bootMode = (uint8_t)mode;
+	Save();
+}
+
+// Reads every slot once and keeps the newest valid record in RAM
+void Registers_t::Load(void)
+{
+	MRF_config_t candidate;
+	uint8_t found = 0;
+
+	if (loaded) return;
+
+	for (uint8_t i = 0; i < MRF_CONFIG_SLOTS; i++)
+	{
+		EEPROM.get(SlotAddress(i), candidate);
+
+		if (candidate.version != MRF_CONFIG_VERSION) continue;
+		if (candidate.crc != ConfigCrc(candidate)) continue;
+		if (candidate.bootProfile >= MRF_PROFILE_COUNT) continue;
+
+		// Sequence numbers wrap, compare them by their difference
+		if (found && (int8_t)(candidate.sequence - config.sequence) <= 0) continue;
+
+		config = candidate;
+		slot   = i;
+		found  = 1;
+	}
+
+	loaded = 1;
+
+	if (!found) SetEEPROMDefaults();
+}
+
+// Writes the record to the slot after the current one
+void Registers_t::Save(void)
+{
+	slot = (slot + 1) % MRF_CONFIG_SLOTS;
+
+	config.version  = MRF_CONFIG_VERSION;
+	config.sequence++;
+	config.crc      = ConfigCrc(config);
+
+	// EEPROM.put() skips cells that already hold the right value
+	EEPROM.put(SlotAddress(slot), config);
 }
 
 void Registers_t::SetEEPROMDefaults(void)
 {
-	EEPROM.write(bootMode, 	 SERIAL);
-	EEPROM.write(afcreg,     0xC4F7);
-    EEPROM.write(txcreg,     0x9810);
-    EEPROM.write(cfsreg,     0xA348);
-    EEPROM.write(rxcreg,     0x94C0);
-    EEPROM.write(bbfcreg,    0xC2AC);
-    EEPROM.write(fiforstreg, 0xCA81);
-    EEPROM.write(synbreg,    0xCED4);
-    EEPROM.write(drsreg,     0xC623);
-    EEPROM.write(pllcreg,    0xCC77);
-}
\ No newline at end of file
+	config.bootMode    = MODE_SERIAL;
+	config.bootProfile = 0;
+
+	for (uint8_t p = 0; p < MRF_PROFILE_COUNT; p++)
+	{
+		memset(config.profiles[p].name, 0, MRF_PROFILE_NAME_LEN);
+
+		for (uint8_t i = 0; i < MRF_REG_COUNT; i++)
+		{
+			config.profiles[p].registers[i] = pgm_read_word(&defaultRegisters[i]);
+		}
+	}
+
+	strncpy(config.profiles[0].name, "default", MRF_PROFILE_NAME_LEN);
+
+	memset(config.key, 0, CRYPTO_KEY_LEN);
+	config.epoch = 0;
+
+	Save();
+}
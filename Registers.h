@@ -14,45 +14,109 @@
 
 #include <Arduino.h>
 #include "Modes.h"
+#include "Crypto.h"
 
-// These registers are fully under user control
-/*
-uint16_t EEMEM afcreg      = 0xC4F7;
-uint16_t EEMEM txcreg      = 0x9810;
-uint16_t EEMEM cfsreg      = 0xA348;
-uint16_t EEMEM rxcreg      = 0x94C0;
-uint16_t EEMEM bbfcreg     = 0xC2AC;
-uint16_t EEMEM fiforstreg  = 0xCA81;
-uint16_t EEMEM synbreg     = 0xCED4;
-uint16_t EEMEM drsreg      = 0xC623;
-uint16_t EEMEM pllcreg     = 0xCC77;
-*/
-
-#define garbage    0x0000
-#define bootMode   0x0002
-#define afcreg     0x0004
-#define txcreg     0x0006
-#define cfsreg     0x0008
-#define rxcreg     0x000A
-#define bbfcreg    0x000C
-#define fiforstreg 0x000E
-#define synbreg    0x0010
-#define drsreg     0x0012
-#define pllcreg    0x0014
+// These registers are fully under user control, the index is the one used
+// with SetRegisterValue() and in the saved configuration.
+#define MRF_REG_AFCREG     0
+#define MRF_REG_TXCREG     1
+#define MRF_REG_CFSREG     2
+#define MRF_REG_RXCREG     3
+#define MRF_REG_BBFCREG    4
+#define MRF_REG_FIFORSTREG 5
+#define MRF_REG_SYNBREG    6
+#define MRF_REG_DRSREG     7
+#define MRF_REG_PLLCREG    8
+#define MRF_REG_COUNT      9
+
+// Several complete register sets (profiles) can be stored, e.g. a long
+// range, low rate profile and a short range, high rate one.  They are kept
+// in RAM after boot so switching between them never touches the EEPROM.
+#define MRF_PROFILE_COUNT    4
+#define MRF_PROFILE_NAME_LEN 8
+#define MRF_PROFILE_NONE     0xFF
+
+typedef struct {
+	char     name[MRF_PROFILE_NAME_LEN];  // Not necessarily terminated
+	uint16_t registers[MRF_REG_COUNT];    // Full register commands
+} MRF_profile_t;
+
+// The configuration is stored as a single record with a version and CRC.
+// To spread the EEPROM wear, each save goes to the next of several slots
+// and the valid slot with the newest sequence number is used at boot.
+// Saving only writes the cells that differ from what the slot holds.
+#define MRF_CONFIG_VERSION 3
+#define MRF_CONFIG_BASE    0x0000
+#define MRF_CONFIG_SLOTS   4
+
+typedef struct {
+	uint8_t  version;                     // MRF_CONFIG_VERSION
+	uint8_t  sequence;                    // Incremented by every save
+	uint8_t  bootMode;                    // enum device_mode
+	uint8_t  bootProfile;                 // Profile applied at boot
+	MRF_profile_t profiles[MRF_PROFILE_COUNT];
+	uint8_t  key[CRYPTO_KEY_LEN];         // Network key, all zero if unset
+	uint16_t epoch;                       // Nonce epoch, see Crypto.h
+	uint8_t  crc;                         // CRC-8 of the fields above
+} MRF_config_t;
 
 class Registers_t
 {
 public:
 	void ApplySavedRegisters(void);
+
+	// Brings the transceiver up with the saved registers in place of the
+	// defaults, without blocking; see MRF49XA.Begin().  Replaces
+	// MRF49XA.Initialize(), ApplySavedRegisters() and the Reset() after.
+	void Begin(void);
 	void PrintSavedRegisters(void);
+
+	// Changes a register of the boot profile, saves it and applies it
 	void SetRegisterValue(uint8_t index, uint16_t value);
 
+	// Writes a register without saving it, e.g. to retune.  The change
+	// lasts until the next profile switch, which sees it: anything that
+	// writes one of the registers above while running goes through here,
+	// so ApplyProfile() diffs against what the transceiver really holds.
+	void ApplyRegisterValue(uint8_t index, uint16_t value);
+
+	// Switches to a stored profile.  Only the registers that differ from the
+	// ones currently applied are written, followed by a single reset.  That
+	// is at most MRF_REG_COUNT + 6 SPI commands (roughly 100us with the
+	// default 4MHz SPI clock), and the EEPROM isn't accessed.  Call it while
+	// the transceiver is idle, a frame in progress is lost.
+	void ApplyProfile(uint8_t index);
+	uint8_t FindProfile(const char *name);	// MRF_PROFILE_NONE if missing
+	uint8_t GetProfile(void);				// Currently applied profile
+
+	// Stores a profile in EEPROM, the name is truncated to 8 characters
+	void SetProfile(uint8_t index, const char *name, const uint16_t *registers);
+	void SetBootProfile(uint8_t index);
+
+	// Stores the network key for encrypted frames (NULL to remove it) and
+	// applies it.  The nonce epoch is advanced and saved before the first
+	// encrypted frame after every reset or new key, so nonces are never
+	// reused; that frame waits for the EEPROM write (a few ms).
+	void SetKey(const uint8_t *key);
+
+	// Advances and saves the nonce epoch, for Crypto
+	uint16_t NextEpoch(void);
+
 	enum device_mode GetBootState(void);
 	void SetBootState(enum device_mode mode);
 private:
+	void Load(void);
+	void Save(void);
 	void SetEEPROMDefaults(void);
+	void ApplyKey(void);
+
+	MRF_config_t config;
+	uint16_t applied[MRF_REG_COUNT];		// Register image in the transceiver
+	uint8_t profile;
+	uint8_t slot;
+	uint8_t loaded;
 };
 
 extern Registers_t Registers;
 
- #endif
\ No newline at end of file
+ #endif
@@ -0,0 +1,204 @@
+/*
+ *  TimeSync.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include <Arduino.h>
+#include "TimeSync.h"
+#include "MRF49XA.h"
+#include "PacketTypes.h"
+
+TimeSync_t TimeSync = TimeSync_t();
+
+static uint32_t GetTime(const uint8_t *field)
+{
+	uint32_t time = 0;
+
+	for (uint8_t i = 0; i < 4; i++) time |= (uint32_t)field[i] << (8 * i);
+
+	return time;
+}
+
+static void PutTime(uint8_t *field, uint32_t time)
+{
+	for (uint8_t i = 0; i < 4; i++) field[i] = time >> (8 * i);
+}
+
+void TimeSync_t::Begin(uint8_t reference, uint16_t interval)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	this->reference = reference;
+	this->interval = interval;
+	synchronized = 0;
+	lastSent = millis() - interval;
+}
+
+void TimeSync_t::Service(void)
+{
+	if (reference == MRF_ADDRESS_BROADCAST) return;
+	if (millis() - lastSent < interval) return;
+
+	lastSent = millis();
+	SendRequest();
+}
+
+void TimeSync_t::SendRequest(void)
+{
+	MRF_packet_t packet;
+
+	packet.type = PACKET_TYPE_TIME | PACKET_FLAG_ADDRESSED;
+	packet.address = reference;
+	packet.payloadSize = TIMESYNC_REQUEST_LEN;
+
+	packet.payload[TIMESYNC_OFFSET_KIND]     = TIMESYNC_REQUEST;
+	packet.payload[TIMESYNC_OFFSET_SEQUENCE] = ++sequence;
+	packet.payload[TIMESYNC_OFFSET_SOURCE]   = MRF49XA.GetAddress();
+
+	// The driver fills in the sent time
+	PutTime(&packet.payload[TIMESYNC_OFFSET_SENT], 0);
+
+	MRF49XA.TransmitPacket(&packet);
+	stats.requests++;
+}
+
+void TimeSync_t::SendResponse(MRF_packet_t *request)
+{
+	MRF_packet_t packet;
+
+	packet.type = PACKET_TYPE_TIME | PACKET_FLAG_ADDRESSED;
+	packet.address = request->payload[TIMESYNC_OFFSET_SOURCE];
+	packet.payloadSize = TIMESYNC_RESPONSE_LEN;
+
+	packet.payload[TIMESYNC_OFFSET_KIND]     = TIMESYNC_RESPONSE;
+	packet.payload[TIMESYNC_OFFSET_SEQUENCE] = request->payload[TIMESYNC_OFFSET_SEQUENCE];
+	packet.payload[TIMESYNC_OFFSET_SOURCE]   = MRF49XA.GetAddress();
+
+	PutTime(&packet.payload[TIMESYNC_OFFSET_SENT], 0);
+	PutTime(&packet.payload[TIMESYNC_OFFSET_ORIGIN], GetTime(&request->payload[TIMESYNC_OFFSET_SENT]));
+	PutTime(&packet.payload[TIMESYNC_OFFSET_RECEIVED], MRF49XA.GetFrameInfo().timestamp);
+
+	MRF49XA.TransmitPacket(&packet);
+}
+
+uint8_t TimeSync_t::PacketReceived(MRF_packet_t *packet)
+{
+	uint8_t kind = packet->type & PACKET_TYPE_MASK;
+
+	if (kind != PACKET_TYPE_TIME && kind != PACKET_TYPE_TIME_ECC) return 0;
+	if (packet->payloadSize < TIMESYNC_REQUEST_LEN) return 1;
+
+	if (packet->payload[TIMESYNC_OFFSET_KIND] == TIMESYNC_REQUEST)
+	{
+		SendResponse(packet);
+		return 1;
+	}
+
+	if (packet->payload[TIMESYNC_OFFSET_KIND] != TIMESYNC_RESPONSE) return 1;
+	if (packet->payloadSize < TIMESYNC_RESPONSE_LEN) return 1;
+
+	// Only the answer to the last request, from the reference
+	if (packet->payload[TIMESYNC_OFFSET_SOURCE] != reference ||
+		packet->payload[TIMESYNC_OFFSET_SEQUENCE] != sequence)
+	{
+		stats.rejected++;
+		return 1;
+	}
+
+	Update(GetTime(&packet->payload[TIMESYNC_OFFSET_ORIGIN]),
+		   GetTime(&packet->payload[TIMESYNC_OFFSET_RECEIVED]),
+		   GetTime(&packet->payload[TIMESYNC_OFFSET_SENT]),
+		   MRF49XA.GetFrameInfo().timestamp);
+
+	return 1;
+}
+
+// t1 request sent, t2 request received (reference clock), t3 response sent
+// (reference clock), t4 response received
+void TimeSync_t::Update(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4)
+{
+	int32_t out  = (int32_t)(t2 - t1);
+	int32_t back = (int32_t)(t4 - t3);
+	int32_t delay = (out + back) / 2;
+	int32_t offset = (out - back) / 2;
+
+	if (delay < 0 || delay > TIMESYNC_DELAY_MAX)
+	{
+		stats.rejected++;
+		return;
+	}
+
+	if (synchronized)
+	{
+		int32_t elapsed = (int32_t)(t4 - syncedAt);
+
+		if (elapsed > 0)
+		{
+			int32_t drift = ((int64_t)(offset - stats.offset) << 20) / elapsed;
+
+			stats.drift += (drift - stats.drift) >> TIMESYNC_DRIFT_SHIFT;
+		}
+	}
+
+	stats.offset = offset;
+	stats.delay = delay;
+	stats.exchanges++;
+	syncedAt = t4;
+	synchronized = 1;
+}
+
+// Offset at a local time, extrapolated with the drift
+int32_t TimeSync_t::Offset(uint32_t local)
+{
+	int32_t elapsed = (int32_t)(local - syncedAt);
+
+	return stats.offset + (int32_t)(((int64_t)stats.drift * elapsed) >> 20);
+}
+
+uint8_t TimeSync_t::IsSynchronized(void)
+{
+	return synchronized;
+}
+
+uint32_t TimeSync_t::Now(void)
+{
+	uint32_t local = micros();
+
+	return local + Offset(local);
+}
+
+uint32_t TimeSync_t::ToLocal(uint32_t time)
+{
+	// The drift term hardly changes over the difference, one step is enough
+	return time - Offset(time - stats.offset);
+}
+
+MRF_timesync_stats_t TimeSync_t::GetStats(void)
+{
+	return stats;
+}
+
+const char exchangesString[] PROGMEM = "\n\rExchanges:   ";
+const char rejectedString[]  PROGMEM = "\n\rRejected:    ";
+const char offsetString[]    PROGMEM = "\n\rOffset us:   ";
+const char driftString[]     PROGMEM = "\n\rDrift ppm:   ";
+const char delayString[]     PROGMEM = "\n\rDelay us:    ";
+
+void TimeSync_t::Report(Print &out)
+{
+	out.print(exchangesString);
+	out.print(stats.exchanges, DEC);
+	out.print('/');
+	out.print(stats.requests, DEC);
+	out.print(rejectedString);
+	out.print(stats.rejected, DEC);
+	out.print(offsetString);
+	out.print(stats.offset, DEC);
+	out.print(driftString);
+	out.print(stats.drift, DEC);
+	out.print(delayString);
+	out.print(stats.delay, DEC);
+}
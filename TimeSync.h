@@ -0,0 +1,80 @@
+/*
+ *  TimeSync.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <Arduino.h>
+#include "MRF49XA.h"
+
+// Exchanges whose round trip (less the reference's turnaround) is longer
+// than this, in microseconds, are ignored.  Something delayed one of the
+// timestamps, e.g. a long interrupt.
+#define TIMESYNC_DELAY_MAX   20000
+
+// Each exchange moves the drift estimate 1/2^TIMESYNC_DRIFT_SHIFT of the
+// way to the drift it measured
+#define TIMESYNC_DRIFT_SHIFT 2
+
+typedef struct {
+	uint16_t requests;			// Requests sent
+	uint16_t exchanges;			// Responses used
+	uint16_t rejected;			// Responses that were late or too slow
+	int32_t  offset;			// Reference minus local time, microseconds
+	int32_t  drift;				// Microseconds per 2^20 (about ppm)
+	uint32_t delay;				// One-way, sync word out to length byte in
+} MRF_timesync_stats_t;
+
+// Two-way time synchronization against a reference node.  The request and
+// the response both carry the time their sync word went out, written by
+// the driver, and the response adds when the request's sync word arrived.
+// With the arrival of the response that's four timestamps, and the offset
+// between the clocks and the link delay follow the same way as in NTP.
+// Both assume the delay is the same either way; the fixed latency of the
+// interrupts cancels out.
+//
+// Every node answers requests, so the reference needs nothing set up
+// beyond handing packets to PacketReceived().
+class TimeSync_t
+{
+public:
+	// Follows the clock of reference, asking every interval milliseconds.
+	// MRF_ADDRESS_BROADCAST only answers requests.  The node address must
+	// be set (MRF49XA.SetAddress()) for the responses to come back.
+	void Begin(uint8_t reference, uint16_t interval);
+
+	// Call from loop(), sends the next request when it's due
+	void Service(void);
+
+	// Hand every received packet to this.  Answers requests, and uses
+	// responses.  Returns 1 if it was a time sync frame and was consumed.
+	uint8_t PacketReceived(MRF_packet_t *packet);
+
+	uint8_t IsSynchronized(void);
+	uint32_t Now(void);						// Reference time, microseconds
+	uint32_t ToLocal(uint32_t time);		// Reference time to micros()
+	MRF_timesync_stats_t GetStats(void);
+	void Report(Print &out);
+private:
+	void SendRequest(void);
+	void SendResponse(MRF_packet_t *request);
+	void Update(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+	int32_t Offset(uint32_t local);
+
+	MRF_timesync_stats_t stats;
+	uint8_t reference;
+	uint8_t sequence;
+	uint8_t synchronized;
+	uint16_t interval;
+	uint32_t lastSent;
+	uint32_t syncedAt;			// Local time of the last offset
+};
+
+extern TimeSync_t TimeSync;
+
+#endif
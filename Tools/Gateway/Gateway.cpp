@@ -0,0 +1,433 @@
+/*
+ *  Gateway.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Linux gateway for a radio board running the capture stream (see
+ *  CaptureFormat.h).  Records are read from the serial port, checked,
+ *  Hamming-decoded if they carry raw ECC symbols, and handed to every
+ *  client connected to a UNIX socket.
+ *
+ *  Build from this directory with:
+ *
+ *      g++ -std=c++11 -O2 -I../.. Gateway.cpp ../../Hamming.cpp -o mrf-gateway
+ *
+ *  The socket is SOCK_SEQPACKET, so every message is exactly one record in
+ *  the CaptureFormat.h layout, without the trailing CRC.  Raw ECC payloads
+ *  are decoded by the gateway and CAPTURE_FLAG_RAW is cleared.  Each
+ *  record is decoded once into a shared buffer; clients only hold
+ *  references to it, nothing is copied per client.
+ *
+ *  Any character device works as the serial port, so the gateway can be
+ *  tested without hardware by writing a capture stream into a pty pair.
+ *  PtyTest.cpp does that end to end, see there.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "CaptureFormat.h"
+#include "PacketTypes.h"
+#include "Crc.h"
+#include "Hamming.h"
+
+// Records a slow client may have queued before the oldest are dropped
+#define GATEWAY_CLIENT_QUEUE 256
+
+typedef std::shared_ptr<const std::vector<uint8_t> > Record;
+
+struct Client
+{
+	std::deque<Record> queue;
+	unsigned long dropped;
+};
+
+static int epollFd;
+static int listenFd;
+static int serialFd;
+static const char *socketPath;
+static bool verbose;
+
+static std::map<int, Client> clients;
+
+// The serial bytes of the record being received, up to its delimiter
+static std::vector<uint8_t> pending;
+
+static unsigned long recordCount;
+static unsigned long errorCount;
+
+static speed_t BaudConstant(long baud)
+{
+	switch (baud)
+	{
+		case 9600:   return B9600;
+		case 19200:  return B19200;
+		case 38400:  return B38400;
+		case 57600:  return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 500000: return B500000;
+		case 1000000: return B1000000;
+		default:     return 0;
+	}
+}
+
+static int OpenSerial(const char *path, long baud)
+{
+	struct termios tio;
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+	if (fd < 0) return -1;
+
+	// Anything that isn't a tty (e.g. a fifo) is used as it is
+	if (tcgetattr(fd, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, BaudConstant(baud));
+		cfsetospeed(&tio, BaudConstant(baud));
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	return fd;
+}
+
+static int OpenSocket(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void Watch(int fd, uint32_t events, int op)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+
+	epoll_ctl(epollFd, op, fd, &ev);
+}
+
+static void DropClient(int fd)
+{
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0);
+	close(fd);
+
+	if (verbose) printf("client %d gone, %lu records dropped\n", fd, clients[fd].dropped);
+
+	clients.erase(fd);
+}
+
+// Sends as much of the client's queue as the socket takes
+static void Flush(int fd)
+{
+	Client &client = clients[fd];
+
+	while (!client.queue.empty())
+	{
+		const std::vector<uint8_t> &record = *client.queue.front();
+
+		if (send(fd, record.data(), record.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+			DropClient(fd);
+			return;
+		}
+
+		client.queue.pop_front();
+	}
+
+	// Only ask for writability while there's something to write
+	Watch(fd, client.queue.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT), EPOLL_CTL_MOD);
+}
+
+static void Publish(const Record &record)
+{
+	std::vector<int> ready;
+
+	for (std::map<int, Client>::iterator it = clients.begin(); it != clients.end(); ++it)
+	{
+		Client &client = it->second;
+
+		if (client.queue.size() >= GATEWAY_CLIENT_QUEUE)
+		{
+			client.queue.pop_front();
+			client.dropped++;
+		}
+
+		client.queue.push_back(record);
+		if (client.queue.size() == 1) ready.push_back(it->first);
+	}
+
+	// Flushing may drop clients, so it's done outside of the iteration
+	for (size_t i = 0; i < ready.size(); i++) Flush(ready[i]);
+}
+
+// Decodes a COBS block in place, returns the decoded length or -1
+static long CobsDecode(uint8_t *data, size_t length)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < length)
+	{
+		uint8_t code = data[in++];
+
+		if (code == 0 || in + code - 1 > length) return -1;
+
+		for (uint8_t i = 1; i < code; i++) data[out++] = data[in++];
+
+		// Every block but a full one ends with a zero, except the last
+		if (code != 0xFF && in < length) data[out++] = 0x00;
+	}
+
+	return out;
+}
+
+static void Print(const std::vector<uint8_t> &record)
+{
+	uint32_t time = record[CAPTURE_OFFSET_TIME] | (record[CAPTURE_OFFSET_TIME + 1] << 8) |
+		(record[CAPTURE_OFFSET_TIME + 2] << 16) | ((uint32_t)record[CAPTURE_OFFSET_TIME + 3] << 24);
+
+	printf("%10u type 0x%02X to 0x%02X status 0x%04X length %u\n", time,
+		record[CAPTURE_OFFSET_TYPE], record[CAPTURE_OFFSET_ADDRESS],
+		record[CAPTURE_OFFSET_STATUS] | (record[CAPTURE_OFFSET_STATUS + 1] << 8),
+		record[CAPTURE_OFFSET_LENGTH]);
+}
+
+static void RecordReceived(void)
+{
+	std::shared_ptr<std::vector<uint8_t> > record(new std::vector<uint8_t>());
+
+	record->swap(pending);
+
+	long length = CobsDecode(record->data(), record->size());
+
+	if (length < CAPTURE_HEADER_LEN + CAPTURE_CRC_LEN)
+	{
+		errorCount++;
+		return;
+	}
+
+	uint8_t *data = record->data();
+	uint16_t crc = data[length - 2] | (data[length - 1] << 8);
+
+	length -= CAPTURE_CRC_LEN;
+
+	if (Crc16(data, length) != crc)
+	{
+		errorCount++;
+		return;
+	}
+
+	uint8_t *payload = data + CAPTURE_HEADER_LEN;
+	long payloadLength = length - CAPTURE_HEADER_LEN;
+
+	// Raw ECC symbols arrive low nibble first, decode them in place
+	if (data[CAPTURE_OFFSET_FLAGS] & CAPTURE_FLAG_RAW)
+	{
+		payloadLength /= 2;
+
+		for (long i = 0; i < payloadLength; i++)
+		{
+			payload[i] = Hamming.DecodeNibble(payload[2 * i]) |
+				(Hamming.DecodeNibble(payload[2 * i + 1]) << 4);
+		}
+
+		data[CAPTURE_OFFSET_FLAGS] &= ~CAPTURE_FLAG_RAW;
+	}
+
+	record->resize(CAPTURE_HEADER_LEN + payloadLength);
+	recordCount++;
+
+	if (verbose) Print(*record);
+
+	Publish(record);
+}
+
+static bool SerialReadable(void)
+{
+	uint8_t chunk[4096];
+	ssize_t count;
+
+	while ((count = read(serialFd, chunk, sizeof(chunk))) > 0)
+	{
+		for (ssize_t i = 0; i < count; i++)
+		{
+			if (chunk[i] == 0x00)
+			{
+				if (!pending.empty()) RecordReceived();
+				pending.clear();
+			}
+			// Anything longer than a record is noise, wait for a delimiter
+			else if (pending.size() < CAPTURE_MAX_ENCODED(CAPTURE_MAX_RECORD))
+			{
+				pending.push_back(chunk[i]);
+			}
+		}
+	}
+
+	// A pty reports EIO once the other side closes
+	return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void Accept(void)
+{
+	int fd;
+
+	while ((fd = accept4(listenFd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		clients[fd].dropped = 0;
+		Watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+
+		if (verbose) printf("client %d connected\n", fd);
+	}
+}
+
+// Clients don't send anything, input only tells us they hung up
+static void ClientReadable(int fd)
+{
+	uint8_t discard[256];
+	ssize_t count = recv(fd, discard, sizeof(discard), MSG_DONTWAIT);
+
+	if (count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) DropClient(fd);
+}
+
+static void Usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b baud] [-v] <serial device> <socket path>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long baud = 9600;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b':
+				baud = atol(optarg);
+				if (BaudConstant(baud) == 0) Usage(argv[0]);
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+
+	if (argc - optind != 2) Usage(argv[0]);
+
+	socketPath = argv[optind + 1];
+
+	// Keep the log in order when stdout is redirected
+	setvbuf(stdout, 0, _IOLBF, 0);
+
+	serialFd = OpenSerial(argv[optind], baud);
+	if (serialFd < 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+
+	listenFd = OpenSocket(socketPath);
+	if (listenFd < 0)
+	{
+		perror(socketPath);
+		return 1;
+	}
+
+	// Signals are handled in the event loop like everything else
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, 0);
+	int signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	Watch(serialFd, EPOLLIN, EPOLL_CTL_ADD);
+	Watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+	Watch(signalFd, EPOLLIN, EPOLL_CTL_ADD);
+
+	bool running = true;
+
+	while (running)
+	{
+		struct epoll_event events[16];
+		int count = epoll_wait(epollFd, events, 16, -1);
+
+		if (count < 0 && errno != EINTR) break;
+
+		for (int i = 0; i < count; i++)
+		{
+			int fd = events[i].data.fd;
+
+			if (fd == serialFd)
+			{
+				if (!SerialReadable()) running = false;
+			}
+			else if (fd == listenFd)
+			{
+				Accept();
+			}
+			else if (fd == signalFd)
+			{
+				running = false;
+			}
+			else if (clients.count(fd))
+			{
+				if (events[i].events & (EPOLLHUP | EPOLLERR)) DropClient(fd);
+				else if (events[i].events & EPOLLIN) ClientReadable(fd);
+
+				if (clients.count(fd) && (events[i].events & EPOLLOUT)) Flush(fd);
+			}
+		}
+	}
+
+	fprintf(stderr, "%lu records, %lu errors\n", recordCount, errorCount);
+
+	unlink(socketPath);
+
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ *  PtyTest.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  End-to-end check of the gateway without hardware.  It starts the
+ *  gateway on the slave side of a pty pair, connects to its socket and
+ *  writes a capture stream into the master side: line noise, a record
+ *  with a bad CRC, a plain frame and a raw ECC frame with a bit error in
+ *  one symbol.  Only the two good records may come out, the ECC one
+ *  corrected and decoded.
+ *
+ *  Build from this directory with:
+ *
+ *      g++ -std=c++11 -O2 -I../.. PtyTest.cpp -o mrf-gateway-test
+ *
+ *  and run it with the path of the gateway binary:
+ *
+ *      ./mrf-gateway-test ./mrf-gateway
+ *
+ *  It prints what failed and exits with 1, or exits with 0.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "CaptureFormat.h"
+#include "PacketTypes.h"
+#include "Crc.h"
+#include "Hamming.h"
+
+// How long to wait for the gateway to come up and to answer
+#define TEST_TIMEOUT_MS 2000
+
+static int failures;
+
+static void Check(bool condition, const char *what)
+{
+	if (condition) return;
+
+	fprintf(stderr, "FAIL: %s\n", what);
+	failures++;
+}
+
+static std::vector<uint8_t> CobsEncode(const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> out(1);
+	size_t codeIndex = 0;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		if (data[i] != 0)
+		{
+			out.push_back(data[i]);
+			code++;
+
+			if (code != 0xFF) continue;
+		}
+
+		out[codeIndex] = code;
+		codeIndex = out.size();
+		out.push_back(0);
+		code = 1;
+	}
+
+	out[codeIndex] = code;
+	out.push_back(0x00);
+
+	return out;
+}
+
+// A FRAME record as Capture_t::Record() writes it
+static std::vector<uint8_t> Record(uint32_t time, uint8_t flags, uint8_t type,
+	uint8_t size, const std::vector<uint8_t> &payload, bool damage)
+{
+	std::vector<uint8_t> record;
+
+	for (uint8_t i = 0; i < 4; i++) record.push_back(time >> (8 * i));
+	record.push_back(CAPTURE_RECORD_FRAME);
+	record.push_back(flags);
+	record.push_back(0x34);
+	record.push_back(0x12);
+	record.push_back(type);
+	record.push_back(0xFF);
+	record.push_back(size);
+	record.insert(record.end(), payload.begin(), payload.end());
+
+	uint16_t crc = Crc16(record.data(), record.size());
+
+	if (damage) crc ^= 0x0001;
+
+	record.push_back(crc & 0xFF);
+	record.push_back(crc >> 8);
+
+	return CobsEncode(record);
+}
+
+// Waits for one message from the gateway, returns its length or -1
+static long Receive(int fd, uint8_t *buffer, size_t length, int timeout)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	if (poll(&pfd, 1, timeout) <= 0) return -1;
+
+	return recv(fd, buffer, length, 0);
+}
+
+static int Connect(const char *path)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	// The gateway needs a moment to create the socket
+	for (int waited = 0; waited < TEST_TIMEOUT_MS; waited += 10)
+	{
+		int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+		if (fd < 0) return -1;
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+
+		close(fd);
+		usleep(10000);
+	}
+
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s <gateway binary>\n", argv[0]);
+		return 2;
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		perror("pty");
+		return 2;
+	}
+
+	struct termios tio;
+
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+
+	char directory[] = "/tmp/mrf-gateway-XXXXXX";
+
+	if (mkdtemp(directory) == 0)
+	{
+		perror("mkdtemp");
+		return 2;
+	}
+
+	char socketPath[64];
+
+	snprintf(socketPath, sizeof(socketPath), "%s/gateway.sock", directory);
+
+	pid_t gateway = fork();
+
+	if (gateway == 0)
+	{
+		execl(argv[1], argv[1], ptsname(master), socketPath, (char *)0);
+		perror(argv[1]);
+		_exit(127);
+	}
+
+	int client = Connect(socketPath);
+
+	Check(client >= 0, "connecting to the gateway");
+
+	if (client >= 0)
+	{
+		const uint8_t text[] = "hi!";
+		std::vector<uint8_t> plain;
+		std::vector<uint8_t> symbols;
+		std::vector<uint8_t> stream;
+
+		plain.push_back(0x00);
+		plain.push_back(0x05);
+		plain.push_back(0x00);
+		plain.push_back(0x07);
+		plain.push_back(0x09);
+
+		// Low nibble first, as the driver stores them
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			symbols.push_back(HammingLogic_t::Encode(text[i] & 0x0F));
+			symbols.push_back(HammingLogic_t::Encode(text[i] >> 4));
+		}
+
+		symbols[1] ^= 0x40;
+
+		const char noise[] = "\x00noise\x11\x22";
+
+		stream.insert(stream.end(), noise, noise + sizeof(noise));
+		std::vector<uint8_t> bad = Record(1, 0, PACKET_TYPE_PACKET, 5, plain, true);
+		std::vector<uint8_t> good = Record(2, 0, PACKET_TYPE_PACKET, 5, plain, false);
+		std::vector<uint8_t> raw = Record(3, CAPTURE_FLAG_RAW, PACKET_TYPE_PACKET_ECC, 3, symbols, false);
+
+		stream.insert(stream.end(), bad.begin(), bad.end());
+		stream.insert(stream.end(), good.begin(), good.end());
+		stream.insert(stream.end(), raw.begin(), raw.end());
+
+		Check(write(master, stream.data(), stream.size()) == (ssize_t)stream.size(), "writing the stream");
+
+		uint8_t message[CAPTURE_MAX_RECORD];
+		long length = Receive(client, message, sizeof(message), TEST_TIMEOUT_MS);
+
+		Check(length == CAPTURE_HEADER_LEN + 5, "plain frame length");
+		Check(length > 0 && message[CAPTURE_OFFSET_TIME] == 2, "bad CRC record dropped");
+		Check(length == CAPTURE_HEADER_LEN + 5 &&
+			memcmp(&message[CAPTURE_HEADER_LEN], plain.data(), 5) == 0, "plain frame payload");
+
+		length = Receive(client, message, sizeof(message), TEST_TIMEOUT_MS);
+
+		Check(length == CAPTURE_HEADER_LEN + 3, "ECC frame length");
+		Check(length > 0 && !(message[CAPTURE_OFFSET_FLAGS] & CAPTURE_FLAG_RAW), "ECC frame flagged decoded");
+		Check(length == CAPTURE_HEADER_LEN + 3 &&
+			memcmp(&message[CAPTURE_HEADER_LEN], text, 3) == 0, "ECC frame corrected");
+
+		Check(Receive(client, message, sizeof(message), 200) < 0, "nothing else published");
+
+		close(client);
+	}
+
+	int status = 0;
+
+	kill(gateway, SIGTERM);
+	waitpid(gateway, &status, 0);
+
+	Check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "gateway exit status");
+
+	unlink(socketPath);
+	rmdir(directory);
+
+	if (failures == 0) printf("PASS\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,642 @@
+/*
+ *  Node.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  One simulated node: the driver and the sketch, running on a model of
+ *  the MCU and the transceiver.  The driver keeps its state in globals, so
+ *  every node is its own process; the simulator hands each one the bytes
+ *  its receiver picks up and collects what its transmitter sends.
+ *
+ *  Time is virtual.  It advances by fixed amounts for SPI transfers, calls
+ *  to micros() and passes through loop(), and jumps ahead when the sketch
+ *  and the driver are both waiting.  The sketch runs on its own stack (a
+ *  ucontext), so when it reaches the end of the window it was given it is
+ *  suspended wherever it is, even inside the interrupt or a busy loop in
+ *  the driver, and resumed in the next window.
+ *
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "Simulator.h"
+#include "MRF49XA.h"
+#include "MRF49XA_definitions.h"
+#include "Trace.h"
+
+extern "C" void MRF_IRO_VECTOR(void);
+
+#define NODE_STACK_LEN   (256 * 1024)
+#define NODE_MESSAGE_LEN (1024 * 1024)
+
+// The transmit register holds two bytes, and resets to 0xAAAA
+#define TX_REGISTER_LEN  2
+// The receive FIFO is 16 bits, the interrupt comes after 8 (FFBC)
+#define RX_FIFO_LEN      2
+
+SimRegister PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+SimRegister EICRA, EIMSK, EIFR, SREG;
+SimRegister TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+SimTimer TCNT1;
+
+EEPROMClass EEPROM;
+SPIClass SPI;
+HardwareSerial Serial;
+
+static SimTime now;
+static SimTime windowStart;
+static SimTime until;
+static SimTime nextRun;
+
+static ucontext_t nodeContext;
+static ucontext_t cpuContext;
+
+static std::vector<SimEvent> events;
+static uint32_t randomState = 1;
+
+static uint8_t inInterrupt;
+
+// The transceiver, as far as the air is concerned
+static struct {
+	uint16_t pmcreg;
+	uint16_t gencreg;
+	uint16_t fiforstreg;
+	uint16_t flags;				// Latched STSREG bits
+	SimTime  byteTime;
+
+	// SPI command being clocked in
+	uint8_t  selected;
+	uint8_t  count;
+	uint16_t command;
+
+	// Byte k of a frame goes out at onAir + k * byteTime.  written counts
+	// the bytes put in the TX register, the two of the reset value first.
+	uint8_t  transmitting;
+	SimTime  onAir;
+	uint32_t written;
+
+	// The sync latch locks on to one stream, until it is re-armed
+	uint8_t  listening;
+	SimTime  listenFrom;		// The synthesizer settles after RXCEN
+	SimTime  rxReady;
+	uint8_t  locked;
+	uint32_t stream;
+	uint16_t status;
+
+	std::deque<uint8_t> fifo;
+	std::deque<SimDelivery> pending;
+} radio;
+
+void NodeReport(uint8_t kind, uint8_t data, uint32_t value)
+{
+	SimEvent event;
+
+	memset(&event, 0, sizeof(event));
+	event.time  = now;
+	event.kind  = kind;
+	event.data  = data;
+	event.value = value;
+
+	events.push_back(event);
+}
+
+static void ReportAt(SimTime time, uint8_t kind, uint8_t data, uint32_t value)
+{
+	NodeReport(kind, data, value);
+	events.back().time = time;
+}
+
+SimTime NodeNow(void)
+{
+	return now;
+}
+
+/*******************************************************************************
+ * Transceiver model
+ ******************************************************************************/
+static void UpdateListen(void)
+{
+	uint8_t listening = (radio.pmcreg & MRF_RXCEN) &&
+	                    (radio.gencreg & MRF_FIFOEN) &&
+	                    (radio.fiforstreg & MRF_FSCF);
+
+	if (listening == radio.listening) return;
+
+	radio.listening = listening;
+
+	if (listening)
+	{
+		radio.listenFrom = (radio.rxReady > now) ? radio.rxReady : now;
+	}
+	else
+	{
+		// Clearing FSCF drops the frame and empties the FIFO
+		radio.locked = 0;
+		radio.fifo.clear();
+	}
+
+	ReportAt(listening ? radio.listenFrom : now, SIM_EV_LISTEN, listening, 0);
+}
+
+// Bytes the simulator delivered, up to now
+static void CatchUp(void)
+{
+	while (!radio.pending.empty() && radio.pending.front().time <= now)
+	{
+		SimDelivery delivery = radio.pending.front();
+		radio.pending.pop_front();
+
+		if (delivery.kind == SIM_RX_SYNC)
+		{
+			uint8_t taken = radio.listening && !radio.locked && delivery.time >= radio.listenFrom;
+
+			if (taken)
+			{
+				radio.locked = 1;
+				radio.stream = delivery.stream;
+				radio.status = delivery.status;
+			}
+
+			ReportAt(delivery.time, SIM_EV_LOCK, taken, delivery.stream);
+		}
+		else if (radio.locked && delivery.stream == radio.stream)
+		{
+			if (radio.fifo.size() < RX_FIFO_LEN) radio.fifo.push_back(delivery.data);
+			else radio.flags |= MRF_TXOWRXOF;
+		}
+	}
+}
+
+// When the TX register has room for another byte
+static SimTime TxReady(void)
+{
+	return radio.onAir + (radio.written - 1) * radio.byteTime;
+}
+
+// The FIFO flag, which is also what pulls the interrupt line low
+static uint8_t FifoFlag(void)
+{
+	if (radio.transmitting) return now >= TxReady();
+
+	return radio.locked && !radio.fifo.empty();
+}
+
+// The next time the flag may change by itself, SIM_NEVER if it won't
+static SimTime NextChange(void)
+{
+	SimTime next = SIM_NEVER;
+
+	if (radio.transmitting && TxReady() > now) next = TxReady();
+	if (!radio.pending.empty() && radio.pending.front().time < next) next = radio.pending.front().time;
+
+	return next;
+}
+
+static uint16_t Status(void)
+{
+	uint16_t status = radio.flags;
+
+	if (FifoFlag()) status |= MRF_TXRXFIFO;
+	if (radio.fifo.empty()) status |= MRF_FIFOEM;
+	if (radio.locked) status |= radio.status;
+
+	return status;
+}
+
+static void TransmitByte(uint8_t data)
+{
+	SimTime start = radio.onAir + radio.written * radio.byteTime;
+
+	// Written after its slot, the register ran empty
+	if (start < now) radio.flags |= MRF_TXOWRXOF;
+
+	ReportAt(start, SIM_EV_TX_BYTE, data, 0);
+	radio.written++;
+}
+
+static void PowerCommand(uint16_t command)
+{
+	uint16_t changed = radio.pmcreg ^ command;
+
+	radio.pmcreg = command;
+
+	if ((changed & MRF_TXCEN) && (command & MRF_TXCEN))
+	{
+		radio.transmitting = 1;
+		radio.onAir = now + SIM_SETTLE_US;
+		radio.written = 0;
+
+		ReportAt(radio.onAir, SIM_EV_TX_ON, 0, 0);
+		for (uint8_t i = 0; i < TX_REGISTER_LEN; i++) TransmitByte(0xAA);
+	}
+	else if ((changed & MRF_TXCEN) && radio.transmitting)
+	{
+		radio.transmitting = 0;
+		NodeReport(SIM_EV_TX_OFF, 0, 0);
+	}
+
+	if ((changed & MRF_RXCEN) && (command & MRF_RXCEN)) radio.rxReady = now + SIM_SETTLE_US;
+
+	UpdateListen();
+}
+
+// A command is taken when chip select goes high
+static void Command(uint16_t command)
+{
+	switch (command & 0xFF00)
+	{
+		case MRF_TXBREG:
+			if (radio.transmitting) TransmitByte(command & 0xFF);
+			return;
+		case MRF_PMCREG:
+			PowerCommand(command);
+			return;
+		case MRF_GENCREG:
+			radio.gencreg = command;
+			UpdateListen();
+			return;
+		case MRF_FIFORSTREG:
+			radio.fiforstreg = command;
+			UpdateListen();
+			return;
+		case MRF_DRSREG:
+			radio.byteTime = SimByteTime(command);
+			break;
+		case MRF_AFCCREG:
+		case MRF_SYNBREG:
+			break;
+		default:
+			// Registers with fields in the address byte
+			if ((command & 0xF000) == MRF_CFSREG) break;
+			if ((command & 0xF800) == MRF_RXCREG) break;
+			if ((command & 0xFE00) == MRF_TXCREG) break;
+			return;
+	}
+
+	// The simulator works out the signal from these
+	NodeReport(SIM_EV_REGISTER, 0, command);
+}
+
+/*******************************************************************************
+ * Time and interrupts
+ ******************************************************************************/
+static uint8_t InterruptPending(void)
+{
+	if (inInterrupt) return 0;
+	if (!(SREG.value & 0x80)) return 0;
+	if (!(EIMSK.value & (1 << INT1))) return 0;
+
+	return FifoFlag();
+}
+
+static void Interrupt(void)
+{
+	inInterrupt = 1;
+	SREG.value &= ~0x80;
+
+	MRF_IRO_VECTOR();
+
+	SREG.value |= 0x80;
+	inInterrupt = 0;
+}
+
+// Back to NodeMain() until the simulator runs the node again
+static void Yield(SimTime next)
+{
+	nextRun = next;
+	swapcontext(&cpuContext, &nodeContext);
+}
+
+// Moves the clock to target, taking the interrupts that come due on the
+// way.  With wake set it returns after an interrupt, so the sketch can
+// see what was posted.
+static void Wait(SimTime target, uint8_t wake)
+{
+	for (;;)
+	{
+		CatchUp();
+
+		if (InterruptPending())
+		{
+			Interrupt();
+
+			if (wake) return;
+			continue;
+		}
+
+		if (now >= target) return;
+
+		SimTime next = NextChange();
+		if (target < next) next = target;
+
+		if (next >= until)
+		{
+			now = until;
+			Yield(next);
+			continue;
+		}
+
+		now = next;
+	}
+}
+
+static inline void Advance(SimTime time)
+{
+	Wait(now + time, 0);
+}
+
+SimRegister &SimRegister::operator=(int v)
+{
+	uint8_t old = value;
+
+	value = v;
+
+	if (this == &MRF_CS_PORTx && ((old ^ value) & (1 << MRF_CS_BIT)))
+	{
+		radio.selected = !(value & (1 << MRF_CS_BIT));
+
+		if (radio.selected)
+		{
+			radio.count = 0;
+			radio.command = 0;
+		}
+		else if (radio.count == 2)
+		{
+			Command(radio.command);
+		}
+	}
+
+	return *this;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+	uint8_t out = 0;
+
+	Advance(SIM_SPI_US);
+
+	if (radio.count == 0)
+	{
+		radio.command = data << 8;
+
+		// Any command with the top bit clear reads the status
+		if (!(data & 0x80)) out = Status() >> 8;
+	}
+	else if (radio.count == 1)
+	{
+		radio.command |= data;
+
+		if (!(radio.command & 0x8000))
+		{
+			out = Status() & 0xFF;
+
+			// The latched flags clear once read
+			radio.flags = 0;
+		}
+		else if ((radio.command & 0xFF00) == MRF_RXFIFOREG && !radio.fifo.empty())
+		{
+			out = radio.fifo.front();
+			radio.fifo.pop_front();
+		}
+	}
+
+	radio.count++;
+
+	return out;
+}
+
+void noInterrupts(void)
+{
+	SREG.value &= ~0x80;
+}
+
+void interrupts(void)
+{
+	SREG.value |= 0x80;
+}
+
+// Timer 1 prescaler for each clock select (CS12:0), 0 if it's stopped
+static uint16_t TimerPrescale(void)
+{
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return prescale[TCCR1B & 0x07];
+}
+
+static uint16_t TimerTicks(void)
+{
+	uint16_t divide = TimerPrescale();
+
+	return divide ? (uint16_t)(now * 16 / divide) : 0;
+}
+
+SimTimer::operator uint16_t() const
+{
+	return TimerTicks() - offset;
+}
+
+SimTimer &SimTimer::operator=(int v)
+{
+	offset = TimerTicks() - v;
+	return *this;
+}
+
+uint32_t micros(void)
+{
+	Advance(1);
+
+	return (uint32_t)now;
+}
+
+uint32_t millis(void)
+{
+	Advance(1);
+
+	return (uint32_t)(now / 1000);
+}
+
+void delay(unsigned long ms)
+{
+	Advance((SimTime)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	Advance(us);
+}
+
+// With chip select low SDO is the FIFO flag, nothing else is wired
+int digitalRead(uint8_t pin)
+{
+	Advance(1);
+
+	if (pin == MISO && radio.selected) return FifoFlag();
+
+	return LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) { }
+void pinMode(uint8_t pin, uint8_t mode) { }
+int analogRead(uint8_t pin) { return 0; }
+
+long random(long howBig)
+{
+	if (howBig <= 0) return 0;
+
+	// xorshift32, seeded per node
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+
+	return randomState % howBig;
+}
+
+long random(long howSmall, long howBig)
+{
+	if (howSmall >= howBig) return howSmall;
+
+	return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+	if (seed != 0) randomState = seed;
+}
+
+/*******************************************************************************
+ * The node process
+ ******************************************************************************/
+static uint8_t nodeAddress;
+static SimTraffic nodeTraffic;
+
+static void CpuMain(void)
+{
+	TrafficSetup(nodeAddress, nodeTraffic);
+
+	for (;;)
+	{
+		SimTime due = TrafficLoop();
+
+		if (due <= now) Advance(SIM_LOOP_US);
+		else Wait(due, 1);
+	}
+}
+
+// Passes the records of the driver's trace ring (Trace.h) on to the
+// simulator.  They're stamped with timer 1, which is turned back into
+// virtual time here; the ring is drained every window, long before the
+// 16 bit timer wraps.
+static void DrainTrace(void)
+{
+#ifdef MRF_TRACE
+	MRF_trace_t record;
+	uint16_t divide = TimerPrescale();
+
+	while (Trace.Read(&record))
+	{
+		uint16_t age = (uint16_t)TCNT1 - record.time;
+		SimTime ago = divide ? (SimTime)age * divide / 16 : 0;
+
+		ReportAt(now - std::min(ago, now), SIM_EV_TRACE, record.event,
+			record.state | (record.counter << 8) | (record.data << 16));
+	}
+#endif
+}
+
+static void Send(int fd)
+{
+	DrainTrace();
+
+	static std::vector<uint8_t> message;
+	SimReport report;
+
+	memset(&report, 0, sizeof(report));
+	report.next  = nextRun;
+	report.count = events.size();
+
+	message.resize(sizeof(report) + events.size() * sizeof(SimEvent));
+	memcpy(&message[0], &report, sizeof(report));
+	if (!events.empty()) memcpy(&message[sizeof(report)], &events[0], events.size() * sizeof(SimEvent));
+
+	if (send(fd, &message[0], message.size(), 0) < 0)
+	{
+		perror("node send");
+		_exit(1);
+	}
+
+	events.clear();
+}
+
+void NodeMain(int fd, uint8_t address, const SimTraffic &traffic)
+{
+	static uint8_t buffer[NODE_MESSAGE_LEN];
+	static uint8_t stack[NODE_STACK_LEN];
+
+	nodeAddress = address;
+	nodeTraffic = traffic;
+
+	// Neighbouring seeds give xorshift neighbouring sequences, mix them
+	uint32_t mixed = traffic.seed * 0x9E3779B9u ^ (address + 1) * 0x85EBCA6Bu;
+	mixed ^= mixed >> 16;
+	mixed *= 0x7FEB352Du;
+	mixed ^= mixed >> 15;
+	randomSeed(mixed | 1);
+	memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));
+
+	// Power-on state: interrupts enabled, chip select high, FIFO 0xAAAA
+	SREG.value = 0x80;
+	MRF_CS_PORTx.value = 1 << MRF_CS_BIT;
+	radio.byteTime = SimByteTime(MRF_DRSREG | MRF_DRPV_VALUE);
+
+	getcontext(&cpuContext);
+	cpuContext.uc_stack.ss_sp = stack;
+	cpuContext.uc_stack.ss_size = sizeof(stack);
+	cpuContext.uc_link = NULL;
+	makecontext(&cpuContext, CpuMain, 0);
+
+	for (;;)
+	{
+		ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+
+		if (length < (ssize_t)sizeof(SimCommand)) _exit(0);
+
+		SimCommand command;
+		memcpy(&command, buffer, sizeof(command));
+
+		if (command.command == SIM_CMD_STOP)
+		{
+			for (uint8_t error = 1; error < MRF_ERROR_CLASSES; error++)
+			{
+				NodeReport(SIM_EV_ERRORS, error, MRF49XA.GetErrorCount(error));
+			}
+
+			Send(fd);
+			_exit(0);
+		}
+
+		const SimDelivery *deliveries = (const SimDelivery *)&buffer[sizeof(command)];
+
+		for (uint32_t i = 0; i < command.count; i++) radio.pending.push_back(deliveries[i]);
+
+		windowStart = command.start;
+		until = command.until;
+		if (now < windowStart) now = windowStart;
+
+		swapcontext(&nodeContext, &cpuContext);
+
+		Send(fd);
+	}
+}
@@ -0,0 +1,1225 @@
+/*
+ *  Simulator.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Multi-node channel simulator.  Runs the unmodified driver on many nodes
+ *  at once against a shared radio channel, and reports delivery, goodput
+ *  and latency as the node count, the offered load and the frame types
+ *  change.  Each combination of the lists given on the command line is
+ *  one run; the same seed gives the same results every time.
+ *
+ *  Build from this directory with:
+ *
+ *      g++ -std=gnu++11 -O2 -DARDUINO=10800 -Ihost -I../.. Simulator.cpp \
+ *          Node.cpp Traffic.cpp ../../[A-Z]*.cpp -o mrf-sim
+ *
+ *  e.g. "./mrf-sim -n 5,10,20,40 -l 0.5,2 -t packet,packet-ecc -d 30"
+ *  or, for a sketch that only gets round to the radio every 50 ms,
+ *  "./mrf-sim -n 10 -l 2 -b -P 50"; overrun drops show in link_errors.
+ *
+ *  Add -DMRF_TRACE to record the driver's trace ring (Trace.h) on every
+ *  node; --trace then prints each record to stderr with its virtual time
+ *  and node, in the order the nodes report them.
+ *
+ *  Every node is a forked process running the library and the sketch in
+ *  Traffic.cpp on a model of the transceiver (Node.cpp); the driver keeps
+ *  its state in globals, so one process can't hold two of them.  This
+ *  process owns the channel.  It lets the nodes run in windows of virtual
+ *  time, collects the bytes their transmitters sent, and hands each
+ *  receiver what it picks up.  A transmitter needs SIM_SETTLE_US before
+ *  anything is on the air, and a byte is written a byte period before it
+ *  goes out, so a window shorter than both of those lets every node run
+ *  through it without waiting for the others.  Idle time is skipped.
+ *
+ *  The channel:
+ *
+ *    - Nodes are placed at random in a square.  Path loss is log-distance
+ *      from free space at 1 m, with log-normal shadowing per link.
+ *      Signals arrive after the propagation delay.
+ *    - Each crystal is off by up to the given ppm.  The receiver's AFC
+ *      (AFCCREG) takes out what's within its range, and STSREG reports
+ *      the measured offset.  What's left beyond the receive filter
+ *      (RXBW less the deviation) is attenuated.
+ *    - Bit errors follow noncoherent FSK in the noise and interference of
+ *      the receive bandwidth, with a floor of --ber on every link.
+ *    - Overlapping frames destroy each other's bytes, unless the wanted
+ *      one is --capture dB stronger than the rest (capture effect).
+ *    - The receiver locks on to the first sync word it gets while it's
+ *      armed (FIFORSTREG), and stays on that frame until the driver
+ *      re-arms; a stronger frame that starts later is missed.  After the
+ *      frame ends it keeps reading noise, as the transceiver does.
+ *    - Nodes are half-duplex, and deaf until the synthesizer settles.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Simulator.h"
+#include "MRF49XA.h"
+#include "MRF49XA_definitions.h"
+#include "PacketTypes.h"
+#include "Trace.h"
+
+#define SIM_NODES_MAX        200
+#define SIM_MESSAGE_LEN      (1024 * 1024)
+
+// Frames offered in the last run are still followed this long for the
+// statistics, nothing new is counted
+#define SIM_DRAIN_US         1000000
+
+#define SIM_TX_POWER_DBM     7.0		// OTXPWR 0
+#define SIM_PATH_LOSS_1M_DB  25.2		// Free space, 1 m at 434 MHz
+#define SIM_NOISE_FIGURE_DB  10.0
+#define SIM_FSK_LOSS_DB      8.0		// Demodulator implementation loss
+#define SIM_FILTER_DB_KHZ    3.0		// Beyond the receive filter
+#define SIM_DQD_DB           8.0		// SINR for DQD and clock lock
+#define SIM_AUDIBLE_DB       -10.0		// SNR below which a signal is ignored
+#define SIM_FRES_HZ          2500.0		// 434 MHz band
+#define SIM_METERS_PER_US    299.792458
+
+// Registers.cpp defaults, until a node writes its own
+#define SIM_DEFAULT_TXCREG   0x9810
+#define SIM_DEFAULT_CFSREG   0xA348
+#define SIM_DEFAULT_RXCREG   0x94C0
+#define SIM_DEFAULT_AFCCREG  0xC4F7
+#define SIM_DEFAULT_SYNBREG  0xCED4
+#define SIM_DEFAULT_DRSREG   0xC623
+
+struct Reception
+{
+	uint32_t next;			// Next byte of the stream to be received
+	uint16_t shift;			// Last two bytes, for the sync word
+	uint8_t  locked;		// The receiver is on this stream
+	uint8_t  wasLocked;
+	uint8_t  collided;		// A byte was lost to interference
+	uint8_t  corrupted;		// A bit error
+};
+
+// One transmission, from TXCEN to the transmitter going off
+struct Transmission
+{
+	uint32_t id;
+	int      node;
+	SimTime  onAir;
+	SimTime  off;			// SIM_NEVER while it's on
+	SimTime  byteTime;
+	uint16_t drsreg;
+	uint16_t txcreg;
+	double   power;			// dBm
+	double   frequency;		// Hz
+	std::vector<std::pair<SimTime, uint8_t> > bytes;
+	std::vector<Reception> rx;
+};
+
+struct Node
+{
+	int      fd;
+	pid_t    pid;
+	double   x, y;
+	double   ppm;
+	uint16_t txcreg, cfsreg, rxcreg, afccreg, synbreg, drsreg;
+
+	SimTime  next;
+	uint32_t transmitting;	// Stream being sent, 0 if none
+	std::vector<SimDelivery> outbox;
+	std::vector<std::pair<SimTime, uint8_t> > listen;
+
+	uint32_t lock;			// Stream the sync latch is on, 0 if none
+	SimTime  lockAt;
+	SimTime  lastArrival;
+};
+
+struct Link
+{
+	double   loss;			// dB
+	SimTime  delay;
+};
+
+struct Sent
+{
+	SimTime  time;
+	uint8_t  destination;
+	std::set<uint8_t> receivers;
+};
+
+struct Stats
+{
+	uint64_t offered;
+	uint64_t expected;
+	uint64_t delivered;
+	uint64_t duplicates;
+	uint64_t frames;
+	uint64_t airtime;
+	uint64_t locks;
+	uint64_t collided;
+	uint64_t corrupted;
+	uint64_t busy;			// Sync word went by while locked on another frame
+	uint64_t deaf;			// ...while sending, settling or not armed
+	uint64_t damaged;		// Delivered by the driver, failed the payload CRC
+	uint64_t errors[MRF_ERROR_CLASSES];
+	std::vector<SimTime> latency;
+};
+
+// Settings
+static std::vector<int> nodeCounts;
+static std::vector<double> loads;
+static std::vector<uint8_t> types;
+static uint8_t whiten;
+static uint8_t broadcast;
+static uint8_t payloadSize = 16;
+static double bitrate;
+static double duration = 10.0;
+static uint32_t seed = 1;
+static double area = 500.0;
+static double exponent = 3.0;
+static double shadowing = 4.0;
+static double berFloor;
+static double captureDb = 6.0;
+static double ppmRange = 10.0;
+static double pollInterval;
+static uint8_t csv;
+static uint8_t trace;
+
+// The run
+static std::vector<Node> nodes;
+static std::vector<std::vector<Link> > links;
+static std::vector<Transmission> streams;
+static std::map<uint64_t, Sent> sent;
+static Stats stats;
+static uint32_t streamCount;
+static uint64_t randomState;
+static SimTime measureEnd;
+
+static uint8_t message[SIM_MESSAGE_LEN];
+
+/*******************************************************************************
+ * Random numbers, from the seed only
+ ******************************************************************************/
+static uint64_t Random(void)
+{
+	// splitmix64
+	uint64_t z = (randomState += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+static double Uniform(void)
+{
+	return (Random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double Gaussian(void)
+{
+	double u = Uniform() + 1e-300;
+	double v = Uniform();
+
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/*******************************************************************************
+ * Radio parameters, from the registers each node wrote
+ ******************************************************************************/
+static double ToMilliwatts(double dbm)
+{
+	return pow(10.0, dbm / 10.0);
+}
+
+static double ToDbm(double milliwatts)
+{
+	return 10.0 * log10(milliwatts);
+}
+
+static double RxBandwidth(const Node &node)
+{
+	static const double kHz[8] = { 400, 400, 340, 270, 200, 134, 67, 67 };
+
+	return kHz[(node.rxcreg & MRF_RXBW_MASK) >> 5] * 1000.0;
+}
+
+static double Deviation(uint16_t txcreg)
+{
+	return (((txcreg & MRF_MODBW_MASK) >> 4) + 1) * 15000.0;
+}
+
+static double TxPower(const Node &node)
+{
+	static const double attenuation[8] = { 0, 2.5, 5.0, 7.5, 10.5, 12.5, 15.0, 17.5 };
+
+	return SIM_TX_POWER_DBM - attenuation[node.txcreg & MRF_OTXPWR_MASK];
+}
+
+static double Frequency(const Node &node)
+{
+	double nominal = 430e6 + (node.cfsreg & MRF_FREQB_MASK) * SIM_FRES_HZ;
+
+	return nominal * (1.0 + node.ppm * 1e-6);
+}
+
+static double NoiseFloor(const Node &node)
+{
+	return -174.0 + 10.0 * log10(RxBandwidth(node)) + SIM_NOISE_FIGURE_DB;
+}
+
+static double RssiThreshold(const Node &node)
+{
+	static const double lna[4] = { 0, 6, 14, 20 };
+
+	return -103.0 + 6.0 * (node.rxcreg & MRF_DRSSIT_MASK) + lna[(node.rxcreg & MRF_RXLNA_MASK) >> 3];
+}
+
+static uint8_t AfcEnabled(const Node &node)
+{
+	return (node.afccreg & 0x00C0) && (node.afccreg & MRF_FOFEN);
+}
+
+// Correction range of ARFO, in Fres steps
+static void AfcRange(const Node &node, int *low, int *high)
+{
+	static const int limit[4] = { 16, 16, 8, 4 };
+	int range = limit[(node.afccreg & 0x0030) >> 4];
+
+	*low = -range;
+	*high = range - 1;
+}
+
+// Attenuation of a signal that far from the middle of the receive filter
+static double FilterLoss(const Node &receiver, uint16_t txcreg, double offset)
+{
+	double tolerance = RxBandwidth(receiver) / 2.0 - Deviation(txcreg);
+
+	if (tolerance < 0) tolerance = 0;
+
+	double excess = fabs(offset) - tolerance;
+
+	return (excess > 0) ? excess / 1000.0 * SIM_FILTER_DB_KHZ : 0.0;
+}
+
+static double BitErrorRate(const Node &receiver, double sinr)
+{
+	double bitsPerSecond = 8e6 / SimByteTime(receiver.drsreg);
+	double ebn0 = sinr * RxBandwidth(receiver) / bitsPerSecond / ToMilliwatts(SIM_FSK_LOSS_DB);
+	double ber = 0.5 * exp(-ebn0 / 2.0);
+
+	if (ber < berFloor) ber = berFloor;
+	if (ber > 0.5) ber = 0.5;
+
+	return ber;
+}
+
+/*******************************************************************************
+ * The channel
+ ******************************************************************************/
+static Transmission *FindStream(uint32_t id)
+{
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		if (streams[i].id == id) return &streams[i];
+	}
+
+	return NULL;
+}
+
+static uint8_t Listening(const Node &node, SimTime time)
+{
+	for (size_t i = node.listen.size(); i-- > 0;)
+	{
+		if (node.listen[i].first <= time) return node.listen[i].second;
+	}
+
+	return 0;
+}
+
+static void ClearLock(Node &node)
+{
+	Transmission *stream = FindStream(node.lock);
+
+	if (stream) stream->rx[&node - &nodes[0]].locked = 0;
+
+	node.lock = 0;
+}
+
+static void Deliver(Node &node, SimTime time, uint32_t stream, uint8_t kind, uint8_t data, uint16_t status)
+{
+	SimDelivery delivery;
+
+	memset(&delivery, 0, sizeof(delivery));
+	delivery.time   = time;
+	delivery.stream = stream;
+	delivery.kind   = kind;
+	delivery.data   = data;
+	delivery.status = status;
+
+	node.outbox.push_back(delivery);
+	node.lastArrival = time;
+}
+
+// Where the receiver's AFC puts the wanted signal, and what it measured
+static double AfcCorrection(const Node &receiver, double offset, int *measured)
+{
+	int steps = (int)lround(offset / SIM_FRES_HZ);
+	int low, high;
+
+	*measured = std::max(-16, std::min(15, steps));
+
+	if (!AfcEnabled(receiver)) return 0.0;
+
+	AfcRange(receiver, &low, &high);
+
+	return std::max(low, std::min(high, steps)) * SIM_FRES_HZ;
+}
+
+// Power of the other signals on the air while the byte comes in, mW
+static double Interference(const Transmission &wanted, int r, SimTime begin, SimTime end, double correction)
+{
+	const Node &receiver = nodes[r];
+	double total = 0.0;
+
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		const Transmission &other = streams[i];
+
+		if (other.id == wanted.id || other.node == r) continue;
+
+		SimTime delay = links[other.node][r].delay;
+		SimTime from = other.onAir + delay;
+		SimTime to = (other.off == SIM_NEVER) ? SIM_NEVER : other.off + delay;
+
+		if (from >= end || to <= begin) continue;
+
+		double offset = other.frequency - Frequency(receiver) - correction;
+		double power = other.power - links[other.node][r].loss - FilterLoss(receiver, other.txcreg, offset);
+
+		total += ToMilliwatts(power);
+	}
+
+	return total;
+}
+
+static void Receive(Transmission &stream, int r, uint32_t index, SimTime arrival)
+{
+	Node &receiver = nodes[r];
+	Reception &rx = stream.rx[r];
+	const Link &link = links[stream.node][r];
+
+	// The latch was re-armed, the rest of the frame goes nowhere
+	if (rx.locked && receiver.lock != stream.id) rx.locked = 0;
+
+	int measured;
+	double offset = stream.frequency - Frequency(receiver);
+	double correction = AfcCorrection(receiver, offset, &measured);
+
+	double signal = stream.power - link.loss - FilterLoss(receiver, stream.txcreg, offset - correction);
+	double noise = ToMilliwatts(NoiseFloor(receiver));
+
+	if (!rx.locked && signal - NoiseFloor(receiver) < SIM_AUDIBLE_DB) return;
+
+	SimTime begin = stream.bytes[index].first + link.delay;
+	double interference = Interference(stream, r, begin, begin + stream.byteTime, correction);
+	double wanted = ToMilliwatts(signal);
+	double sinr = wanted / (noise + interference);
+
+	uint8_t data = stream.bytes[index].second;
+
+	if (interference > 0 && ToDbm(wanted / interference) < captureDb)
+	{
+		data = Random();
+		if (rx.locked) rx.collided = 1;
+	}
+	else
+	{
+		double ber = BitErrorRate(receiver, sinr);
+
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (Uniform() < ber)
+			{
+				data ^= 1 << bit;
+				if (rx.locked) rx.corrupted = 1;
+			}
+		}
+	}
+
+	if (rx.locked)
+	{
+		Deliver(receiver, arrival, stream.id, SIM_RX_BYTE, data, 0);
+		return;
+	}
+
+	rx.shift = (rx.shift << 8) | data;
+
+	if (rx.shift != (0x2D00 | (receiver.synbreg & MRF_SYNCB))) return;
+	if (stream.drsreg != receiver.drsreg) return;
+
+	if (receiver.lock)
+	{
+		stats.busy++;
+		return;
+	}
+
+	if (!Listening(receiver, arrival))
+	{
+		stats.deaf++;
+		return;
+	}
+
+	uint16_t status = measured & (MRF_OFFSV | MRF_OFFSET_MASK);
+
+	if (signal > RssiThreshold(receiver)) status |= MRF_ATTRSSI;
+	if (ToDbm(sinr) >= SIM_DQD_DB) status |= MRF_DQDO | MRF_CLKRL;
+
+	rx.locked = 1;
+	rx.wasLocked = 1;
+	receiver.lock = stream.id;
+	receiver.lockAt = arrival;
+
+	Deliver(receiver, arrival, stream.id, SIM_RX_SYNC, 0, status);
+}
+
+// Bytes of the stream that made it out before the transmitter went off
+static uint32_t StreamLength(const Transmission &stream)
+{
+	uint32_t length = stream.bytes.size();
+
+	while (length > 0 && stream.bytes[length - 1].first >= stream.off) length--;
+
+	return length;
+}
+
+struct Arrival
+{
+	SimTime  time;
+	uint32_t stream;
+	int      receiver;
+	uint32_t index;
+
+	bool operator<(const Arrival &other) const
+	{
+		if (time != other.time) return time < other.time;
+		if (stream != other.stream) return stream < other.stream;
+		return receiver < other.receiver;
+	}
+};
+
+// Works out what every receiver gets in [start, end).  Everything that
+// arrives in the window was written, and every transmitter that can be
+// heard in it was turned on, before the window started.
+static void Propagate(SimTime start, SimTime end)
+{
+	std::vector<Arrival> arrivals;
+
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		Transmission &stream = streams[i];
+		uint32_t length = StreamLength(stream);
+
+		for (int r = 0; r < (int)nodes.size(); r++)
+		{
+			if (r == stream.node) continue;
+
+			Reception &rx = stream.rx[r];
+
+			while (rx.next < length)
+			{
+				SimTime arrival = stream.bytes[rx.next].first + stream.byteTime + links[stream.node][r].delay;
+
+				if (arrival >= end) break;
+
+				Arrival entry = { arrival, stream.id, r, rx.next++ };
+				arrivals.push_back(entry);
+			}
+		}
+	}
+
+	std::sort(arrivals.begin(), arrivals.end());
+
+	for (size_t i = 0; i < arrivals.size(); i++)
+	{
+		Receive(*FindStream(arrivals[i].stream), arrivals[i].receiver, arrivals[i].index, arrivals[i].time);
+	}
+
+	// Receivers still on a frame that ended read noise
+	for (size_t r = 0; r < nodes.size(); r++)
+	{
+		Node &node = nodes[r];
+
+		if (!node.lock) continue;
+
+		Transmission *stream = FindStream(node.lock);
+
+		if (stream && (stream->off == SIM_NEVER || stream->rx[r].next < StreamLength(*stream))) continue;
+
+		SimTime byteTime = SimByteTime(node.drsreg);
+
+		for (SimTime t = node.lastArrival + byteTime; t < end; t += byteTime)
+		{
+			Deliver(node, t, node.lock, SIM_RX_BYTE, Random(), 0);
+		}
+	}
+}
+
+// Streams that are over everywhere, with their receptions tallied
+static void Retire(SimTime now)
+{
+	for (size_t i = 0; i < streams.size();)
+	{
+		Transmission &stream = streams[i];
+		uint8_t over = (stream.off != SIM_NEVER) && (stream.off + 2 * stream.byteTime + 1000 < now);
+
+		for (size_t r = 0; over && r < nodes.size(); r++)
+		{
+			if ((int)r != stream.node && stream.rx[r].next < StreamLength(stream)) over = 0;
+			if (nodes[r].lock == stream.id) over = 0;
+		}
+
+		if (!over)
+		{
+			i++;
+			continue;
+		}
+
+		for (size_t r = 0; r < nodes.size(); r++)
+		{
+			if (!stream.rx[r].wasLocked) continue;
+
+			stats.locks++;
+			if (stream.rx[r].collided) stats.collided++;
+			else if (stream.rx[r].corrupted) stats.corrupted++;
+		}
+
+		streams.erase(streams.begin() + i);
+	}
+}
+
+/*******************************************************************************
+ * Node processes
+ ******************************************************************************/
+static uint64_t SentKey(uint8_t source, uint32_t sequence)
+{
+	return ((uint64_t)source << 32) | sequence;
+}
+
+static void Event(int n, const SimEvent &event)
+{
+	Node &node = nodes[n];
+
+	switch (event.kind)
+	{
+		case SIM_EV_TX_ON:
+		{
+			Transmission stream;
+
+			stream.id = ++streamCount;
+			stream.node = n;
+			stream.onAir = event.time;
+			stream.off = SIM_NEVER;
+			stream.byteTime = SimByteTime(node.drsreg);
+			stream.drsreg = node.drsreg;
+			stream.txcreg = node.txcreg;
+			stream.power = TxPower(node);
+			stream.frequency = Frequency(node);
+			stream.rx.resize(nodes.size());
+			memset(&stream.rx[0], 0, stream.rx.size() * sizeof(Reception));
+
+			streams.push_back(stream);
+			node.transmitting = stream.id;
+			stats.frames++;
+			break;
+		}
+		case SIM_EV_TX_BYTE:
+		{
+			Transmission *stream = FindStream(node.transmitting);
+
+			if (stream) stream->bytes.push_back(std::make_pair(event.time, event.data));
+			break;
+		}
+		case SIM_EV_TX_OFF:
+		{
+			Transmission *stream = FindStream(node.transmitting);
+
+			if (stream)
+			{
+				stream->off = event.time;
+				if (event.time > stream->onAir) stats.airtime += event.time - stream->onAir;
+			}
+
+			node.transmitting = 0;
+			break;
+		}
+		case SIM_EV_LISTEN:
+			if (node.listen.size() > 64) node.listen.erase(node.listen.begin(), node.listen.end() - 16);
+			node.listen.push_back(std::make_pair(event.time, event.data));
+
+			if (!event.data && node.lock && event.time >= node.lockAt) ClearLock(node);
+			break;
+		case SIM_EV_LOCK:
+			if (!event.data && node.lock == event.value) ClearLock(node);
+			break;
+		case SIM_EV_REGISTER:
+		{
+			uint16_t value = event.value;
+
+			if ((value & 0xF000) == MRF_CFSREG) node.cfsreg = value;
+			else if ((value & 0xF800) == MRF_RXCREG) node.rxcreg = value;
+			else if ((value & 0xFE00) == MRF_TXCREG) node.txcreg = value;
+			else if ((value & 0xFF00) == MRF_AFCCREG) node.afccreg = value;
+			else if ((value & 0xFF00) == MRF_SYNBREG) node.synbreg = value;
+			else if ((value & 0xFF00) == MRF_DRSREG) node.drsreg = value;
+			break;
+		}
+		case SIM_EV_SENT:
+		{
+			if (event.time >= measureEnd) break;
+
+			Sent &record = sent[SentKey(n, event.value)];
+
+			record.time = event.time;
+			record.destination = event.data;
+
+			stats.offered++;
+			stats.expected += (event.data == MRF_ADDRESS_BROADCAST) ? nodes.size() - 1 : 1;
+			break;
+		}
+		case SIM_EV_RECEIVED:
+		{
+			std::map<uint64_t, Sent>::iterator record = sent.find(SentKey(event.data, event.value));
+
+			if (record == sent.end()) break;
+
+			// Flooded or addressed to someone else, but the driver passed it
+			if (record->second.destination != MRF_ADDRESS_BROADCAST && record->second.destination != n) break;
+
+			if (!record->second.receivers.insert(n).second)
+			{
+				stats.duplicates++;
+				break;
+			}
+
+			stats.delivered++;
+			stats.latency.push_back(event.time - record->second.time);
+			break;
+		}
+		case SIM_EV_DAMAGED:
+			stats.damaged++;
+			break;
+		case SIM_EV_ERRORS:
+			if (event.data < MRF_ERROR_CLASSES) stats.errors[event.data] += event.value;
+			break;
+		case SIM_EV_TRACE:
+			// Time, node, then the fields Trace_t::Dump() prints
+			if (trace)
+			{
+				fprintf(stderr, "%llu %d %X %X %u %X\n", (unsigned long long)event.time, n,
+					event.data, event.value & 0xFF, (event.value >> 8) & 0xFF, (event.value >> 16) & 0xFF);
+			}
+			break;
+	}
+}
+
+static void Command(int n, uint32_t command, SimTime start, SimTime until)
+{
+	Node &node = nodes[n];
+	SimCommand header;
+
+	std::stable_sort(node.outbox.begin(), node.outbox.end(),
+		[](const SimDelivery &a, const SimDelivery &b) { return a.time < b.time; });
+
+	memset(&header, 0, sizeof(header));
+	header.command = command;
+	header.count = node.outbox.size();
+	header.start = start;
+	header.until = until;
+
+	size_t length = sizeof(header) + node.outbox.size() * sizeof(SimDelivery);
+
+	if (length > sizeof(message))
+	{
+		fprintf(stderr, "Too many deliveries for node %d\n", n);
+		exit(1);
+	}
+
+	memcpy(message, &header, sizeof(header));
+	if (!node.outbox.empty()) memcpy(&message[sizeof(header)], &node.outbox[0], node.outbox.size() * sizeof(SimDelivery));
+
+	if (send(node.fd, message, length, 0) < 0)
+	{
+		perror("send");
+		exit(1);
+	}
+
+	node.outbox.clear();
+}
+
+static void Collect(int n)
+{
+	ssize_t length = recv(nodes[n].fd, message, sizeof(message), 0);
+
+	if (length < (ssize_t)sizeof(SimReport))
+	{
+		fprintf(stderr, "Node %d stopped\n", n);
+		exit(1);
+	}
+
+	SimReport report;
+	memcpy(&report, message, sizeof(report));
+
+	nodes[n].next = report.next;
+
+	const SimEvent *events = (const SimEvent *)&message[sizeof(report)];
+
+	for (uint32_t i = 0; i < report.count; i++) Event(n, events[i]);
+}
+
+static void Spawn(const SimTraffic &traffic)
+{
+	for (size_t n = 0; n < nodes.size(); n++)
+	{
+		int pair[2];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) < 0)
+		{
+			perror("socketpair");
+			exit(1);
+		}
+
+		fflush(stdout);
+		pid_t pid = fork();
+
+		if (pid < 0)
+		{
+			perror("fork");
+			exit(1);
+		}
+
+		if (pid == 0)
+		{
+			for (size_t i = 0; i < n; i++) close(nodes[i].fd);
+			close(pair[0]);
+
+			NodeMain(pair[1], n, traffic);
+		}
+
+		close(pair[1]);
+		nodes[n].fd = pair[0];
+		nodes[n].pid = pid;
+	}
+}
+
+/*******************************************************************************
+ * A run
+ ******************************************************************************/
+static void Place(int count)
+{
+	nodes.assign(count, Node());
+	links.assign(count, std::vector<Link>(count));
+
+	for (int n = 0; n < count; n++)
+	{
+		Node &node = nodes[n];
+
+		node.x = Uniform() * area;
+		node.y = Uniform() * area;
+		node.ppm = (2.0 * Uniform() - 1.0) * ppmRange;
+
+		node.txcreg  = SIM_DEFAULT_TXCREG;
+		node.cfsreg  = SIM_DEFAULT_CFSREG;
+		node.rxcreg  = SIM_DEFAULT_RXCREG;
+		node.afccreg = SIM_DEFAULT_AFCCREG;
+		node.synbreg = SIM_DEFAULT_SYNBREG;
+		node.drsreg  = SIM_DEFAULT_DRSREG;
+	}
+
+	for (int a = 0; a < count; a++)
+	{
+		for (int b = a + 1; b < count; b++)
+		{
+			double distance = hypot(nodes[a].x - nodes[b].x, nodes[a].y - nodes[b].y);
+			Link link;
+
+			link.loss = SIM_PATH_LOSS_1M_DB + 10.0 * exponent * log10(std::max(distance, 1.0)) + shadowing * Gaussian();
+			link.delay = (SimTime)lround(distance / SIM_METERS_PER_US);
+
+			links[a][b] = link;
+			links[b][a] = link;
+		}
+	}
+}
+
+// The window, shorter than the settling time and every byte period
+static SimTime Window(void)
+{
+	SimTime window = SIM_SETTLE_US;
+
+	for (size_t n = 0; n < nodes.size(); n++) window = std::min(window, SimByteTime(nodes[n].drsreg));
+
+	return window;
+}
+
+static void Run(const SimTraffic &traffic)
+{
+	SimTime end = (SimTime)(duration * 1e6);
+
+	measureEnd = end;
+	end += SIM_DRAIN_US;
+
+	randomState = seed;
+	streams.clear();
+	sent.clear();
+	stats = Stats();
+	streamCount = 0;
+
+	Place(traffic.nodes);
+	Spawn(traffic);
+
+	SimTime now = 0;
+
+	while (now < end)
+	{
+		SimTime until = now + Window();
+
+		Propagate(now, until);
+
+		std::vector<int> running;
+
+		for (size_t n = 0; n < nodes.size(); n++)
+		{
+			if (nodes[n].outbox.empty() && nodes[n].next >= until) continue;
+
+			Command(n, SIM_CMD_RUN, now, until);
+			running.push_back(n);
+		}
+
+		// The nodes run in parallel, their events are taken in node order
+		for (size_t i = 0; i < running.size(); i++) Collect(running[i]);
+
+		Retire(until);
+		now = until;
+
+		// Nothing on the air, skip to the next node that has work
+		uint8_t idle = streams.empty();
+
+		for (size_t n = 0; idle && n < nodes.size(); n++)
+		{
+			if (nodes[n].lock || nodes[n].transmitting) idle = 0;
+		}
+
+		if (idle)
+		{
+			SimTime next = SIM_NEVER;
+
+			for (size_t n = 0; n < nodes.size(); n++) next = std::min(next, nodes[n].next);
+			if (next > now) now = std::min(next, end);
+		}
+	}
+
+	for (size_t n = 0; n < nodes.size(); n++) Command(n, SIM_CMD_STOP, now, now);
+
+	for (size_t n = 0; n < nodes.size(); n++)
+	{
+		Collect(n);
+		close(nodes[n].fd);
+		waitpid(nodes[n].pid, NULL, 0);
+	}
+}
+
+/*******************************************************************************
+ * Report
+ ******************************************************************************/
+static const char *TypeName(uint8_t type)
+{
+	switch (type)
+	{
+		case PACKET_TYPE_PACKET:     return "packet";
+		case PACKET_TYPE_PACKET_ECC: return "packet-ecc";
+		case PACKET_TYPE_SERIAL:     return "serial";
+		case PACKET_TYPE_SERIAL_ECC: return "serial-ecc";
+	}
+
+	return "?";
+}
+
+static double Percentile(const std::vector<SimTime> &sorted, double fraction)
+{
+	if (sorted.empty()) return 0.0;
+
+	size_t index = (size_t)ceil(fraction * sorted.size());
+	if (index > 0) index--;
+
+	return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+}
+
+static void ReportHeader(void)
+{
+	if (csv)
+	{
+		printf("nodes,load,type,offered,expected,delivered,pdr,goodput_bps,"
+		       "latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms,"
+		       "utilization,locks,collided,corrupted,busy,deaf,damaged,link_errors\n");
+		return;
+	}
+
+	printf("%5s %6s %-10s %7s %7s %7s %6s %8s %7s %7s %7s %7s %5s %6s %6s %6s %6s %6s %6s\n",
+	       "nodes", "load", "type", "offered", "expect", "deliver", "pdr", "goodput",
+	       "p50ms", "p90ms", "p99ms", "maxms", "util", "locks", "collid", "corrup", "busy", "deaf", "damage");
+}
+
+static void Report(const SimTraffic &traffic)
+{
+	std::vector<SimTime> latency = stats.latency;
+	std::sort(latency.begin(), latency.end());
+
+	double pdr = stats.expected ? (double)stats.delivered / stats.expected : 0.0;
+	double goodput = stats.delivered * traffic.size * 8.0 / duration;
+	double utilization = stats.airtime / (duration * 1e6 + SIM_DRAIN_US);
+
+	uint64_t linkErrors = 0;
+	for (uint8_t e = 1; e < MRF_ERROR_CLASSES; e++) linkErrors += stats.errors[e];
+
+	if (csv)
+	{
+		printf("%d,%g,%s,%llu,%llu,%llu,%.4f,%.1f,%.2f,%.2f,%.2f,%.2f,%.4f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+		       traffic.nodes, traffic.load, TypeName(traffic.type),
+		       (unsigned long long)stats.offered, (unsigned long long)stats.expected,
+		       (unsigned long long)stats.delivered, pdr, goodput,
+		       Percentile(latency, 0.5), Percentile(latency, 0.9), Percentile(latency, 0.99),
+		       Percentile(latency, 1.0), utilization,
+		       (unsigned long long)stats.locks, (unsigned long long)stats.collided,
+		       (unsigned long long)stats.corrupted, (unsigned long long)stats.busy,
+		       (unsigned long long)stats.deaf, (unsigned long long)stats.damaged,
+		       (unsigned long long)linkErrors);
+	}
+	else
+	{
+		printf("%5d %6g %-10s %7llu %7llu %7llu %6.3f %8.0f %7.2f %7.2f %7.2f %7.2f %5.2f %6llu %6llu %6llu %6llu %6llu %6llu\n",
+		       traffic.nodes, traffic.load, TypeName(traffic.type),
+		       (unsigned long long)stats.offered, (unsigned long long)stats.expected,
+		       (unsigned long long)stats.delivered, pdr, goodput,
+		       Percentile(latency, 0.5), Percentile(latency, 0.9), Percentile(latency, 0.99),
+		       Percentile(latency, 1.0), utilization,
+		       (unsigned long long)stats.locks, (unsigned long long)stats.collided,
+		       (unsigned long long)stats.corrupted, (unsigned long long)stats.busy,
+		       (unsigned long long)stats.deaf, (unsigned long long)stats.damaged);
+	}
+
+	fflush(stdout);
+}
+
+/*******************************************************************************
+ * Command line
+ ******************************************************************************/
+static void Usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n, --nodes LIST      node counts (10)\n"
+		"  -l, --load LIST       frames per second per node (1)\n"
+		"  -t, --type LIST       packet, packet-ecc, serial, serial-ecc (packet)\n"
+		"  -s, --size N          payload bytes, %d to %d (16)\n"
+		"  -w, --whiten          whiten the payloads\n"
+		"  -b, --broadcast       send to everyone, not a random peer (serial always is)\n"
+		"  -r, --bitrate KBPS    data rate (the default profile's 9.6)\n"
+		"  -d, --duration S      seconds of traffic (10), plus 1 s to drain\n"
+		"  -S, --seed N          placement, crystals and bit errors (1)\n"
+		"  -a, --area M          side of the square the nodes are in (500)\n"
+		"  -e, --exponent X      path loss exponent (3.0)\n"
+		"  -g, --shadowing DB    standard deviation of the shadowing (4)\n"
+		"  -B, --ber P           bit error rate floor on every link (0)\n"
+		"  -c, --capture DB      capture ratio (6)\n"
+		"  -p, --ppm P           crystal tolerance (10)\n"
+		"  -P, --poll MS         read frames with ReceivePacket() this often, a slow\n"
+		"                        consumer holding each until the next read (handler)\n"
+		"      --csv             comma separated output\n"
+		"      --trace           print the driver's trace ring to stderr (build with -DMRF_TRACE)\n"
+		"Lists are comma separated; every combination is run.\n",
+		name, SIM_HEADER_LEN, MRF_PAYLOAD_LEN);
+	exit(2);
+}
+
+static std::vector<std::string> Split(const char *list)
+{
+	std::vector<std::string> items;
+	std::string item;
+
+	for (const char *p = list; ; p++)
+	{
+		if (*p == ',' || *p == '\0')
+		{
+			if (!item.empty()) items.push_back(item);
+			item.clear();
+
+			if (*p == '\0') break;
+		}
+		else item += *p;
+	}
+
+	return items;
+}
+
+static uint8_t ParseType(const std::string &name)
+{
+	if (name == "packet")     return PACKET_TYPE_PACKET;
+	if (name == "packet-ecc") return PACKET_TYPE_PACKET_ECC;
+	if (name == "serial")     return PACKET_TYPE_SERIAL;
+	if (name == "serial-ecc") return PACKET_TYPE_SERIAL_ECC;
+
+	return 0;
+}
+
+// DRSREG for a data rate, see MRF49XA_definitions.h
+static uint16_t RateRegister(double kbps)
+{
+	long value = lround(10000.0 / (29.0 * kbps)) - 1;
+
+	if (value <= MRF_DRPV_MASK) return MRF_DRSREG | std::max(value, 0L);
+
+	value = lround(10000.0 / (29.0 * 8.0 * kbps)) - 1;
+
+	return MRF_DRSREG | MRF_DRPE | std::min(value, (long)MRF_DRPV_MASK);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "nodes",     required_argument, NULL, 'n' },
+		{ "load",      required_argument, NULL, 'l' },
+		{ "type",      required_argument, NULL, 't' },
+		{ "size",      required_argument, NULL, 's' },
+		{ "whiten",    no_argument,       NULL, 'w' },
+		{ "broadcast", no_argument,       NULL, 'b' },
+		{ "bitrate",   required_argument, NULL, 'r' },
+		{ "duration",  required_argument, NULL, 'd' },
+		{ "seed",      required_argument, NULL, 'S' },
+		{ "area",      required_argument, NULL, 'a' },
+		{ "exponent",  required_argument, NULL, 'e' },
+		{ "shadowing", required_argument, NULL, 'g' },
+		{ "ber",       required_argument, NULL, 'B' },
+		{ "capture",   required_argument, NULL, 'c' },
+		{ "ppm",       required_argument, NULL, 'p' },
+		{ "poll",      required_argument, NULL, 'P' },
+		{ "csv",       no_argument,       NULL, 'C' },
+		{ "trace",     no_argument,       NULL, 'T' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int option;
+
+	while ((option = getopt_long(argc, argv, "n:l:t:s:wbr:d:S:a:e:g:B:c:p:P:", options, NULL)) != -1)
+	{
+		std::vector<std::string> items;
+
+		switch (option)
+		{
+			case 'n':
+				items = Split(optarg);
+				for (size_t i = 0; i < items.size(); i++) nodeCounts.push_back(atoi(items[i].c_str()));
+				break;
+			case 'l':
+				items = Split(optarg);
+				for (size_t i = 0; i < items.size(); i++) loads.push_back(atof(items[i].c_str()));
+				break;
+			case 't':
+				items = Split(optarg);
+				for (size_t i = 0; i < items.size(); i++)
+				{
+					uint8_t type = ParseType(items[i]);
+
+					if (!type) Usage(argv[0]);
+					types.push_back(type);
+				}
+				break;
+			case 's': payloadSize = atoi(optarg); break;
+			case 'w': whiten = 1; break;
+			case 'b': broadcast = 1; break;
+			case 'r': bitrate = atof(optarg); break;
+			case 'd': duration = atof(optarg); break;
+			case 'S': seed = strtoul(optarg, NULL, 0); break;
+			case 'a': area = atof(optarg); break;
+			case 'e': exponent = atof(optarg); break;
+			case 'g': shadowing = atof(optarg); break;
+			case 'B': berFloor = atof(optarg); break;
+			case 'c': captureDb = atof(optarg); break;
+			case 'p': ppmRange = atof(optarg); break;
+			case 'P': pollInterval = atof(optarg); break;
+			case 'C': csv = 1; break;
+			case 'T': trace = 1; break;
+			default:  Usage(argv[0]);
+		}
+	}
+
+	if (optind != argc) Usage(argv[0]);
+
+	if (nodeCounts.empty()) nodeCounts.push_back(10);
+	if (loads.empty()) loads.push_back(1.0);
+	if (types.empty()) types.push_back(PACKET_TYPE_PACKET);
+
+	for (size_t i = 0; i < nodeCounts.size(); i++)
+	{
+		if (nodeCounts[i] < 2 || nodeCounts[i] > SIM_NODES_MAX) Usage(argv[0]);
+	}
+
+	for (size_t i = 0; i < loads.size(); i++)
+	{
+		if (loads[i] <= 0) Usage(argv[0]);
+	}
+
+	if (payloadSize < SIM_HEADER_LEN || payloadSize > MRF_PAYLOAD_LEN) Usage(argv[0]);
+	if (duration <= 0 || area <= 0 || bitrate < 0 || pollInterval < 0) Usage(argv[0]);
+
+#ifndef MRF_TRACE
+	if (trace)
+	{
+		fprintf(stderr, "%s: built without MRF_TRACE, there's no trace to print\n", argv[0]);
+		return 2;
+	}
+#endif
+
+	signal(SIGPIPE, SIG_IGN);
+
+	ReportHeader();
+
+	for (size_t t = 0; t < types.size(); t++)
+	{
+		for (size_t n = 0; n < nodeCounts.size(); n++)
+		{
+			for (size_t l = 0; l < loads.size(); l++)
+			{
+				SimTraffic traffic;
+
+				memset(&traffic, 0, sizeof(traffic));
+				traffic.type = types[t];
+				traffic.flags = whiten ? PACKET_FLAG_WHITENED : 0;
+				traffic.broadcast = broadcast;
+				traffic.size = payloadSize;
+				traffic.nodes = nodeCounts[n];
+				traffic.drsreg = bitrate ? RateRegister(bitrate) : 0;
+				traffic.load = loads[l];
+				traffic.seed = seed;
+				traffic.poll = (SimTime)(pollInterval * 1000.0);
+
+				Run(traffic);
+				Report(traffic);
+			}
+		}
+	}
+
+	return 0;
+}
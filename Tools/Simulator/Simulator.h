@@ -0,0 +1,130 @@
+/*
+ *  Simulator.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Settings and messages shared by the simulator (Simulator.cpp) and its
+ *  node processes (Node.cpp, Traffic.cpp).
+ *
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+
+// Virtual time, microseconds since the start of the run
+typedef uint64_t SimTime;
+
+#define SIM_NEVER       UINT64_MAX
+
+// Synthesizer settling time after TXCEN or RXCEN is set.  Nothing reaches
+// the air before it, which is what lets every node run this far ahead of
+// the others without missing a signal (MRF_WAKE_STANDBY_US).
+#define SIM_SETTLE_US   250
+
+// Time taken by one SPI byte, and by a pass through loop() that found
+// nothing to do
+#define SIM_SPI_US      2
+#define SIM_LOOP_US     20
+
+// Payload of every traffic frame: source address, a 32 bit sequence number
+// and a CRC-16 of the whole payload (this field left out), then filler.
+// The driver doesn't check payloads, so damaged frames are delivered.
+#define SIM_OFFSET_SOURCE    0
+#define SIM_OFFSET_SEQUENCE  1
+#define SIM_OFFSET_CRC       5
+#define SIM_HEADER_LEN       7
+
+// Byte period of a DRSREG setting, see MRF49XA_definitions.h.  The nodes
+// and the channel both use this, so they agree to the microsecond.
+static inline SimTime SimByteTime(uint16_t drsreg)
+{
+	uint32_t prescale = (drsreg & 0x0080) ? 8 : 1;
+
+	// 8 bits of 29 * prescale * (R + 1) / 10 MHz each
+	return (8ULL * 29 * prescale * ((drsreg & 0x007F) + 1) + 5) / 10;
+}
+
+// Traffic every node offers, see Traffic.cpp
+typedef struct {
+	uint8_t  type;			// PACKET_TYPE_PACKET, _ECC, _SERIAL or _SERIAL_ECC
+	uint8_t  flags;			// PACKET_FLAG_WHITENED
+	uint8_t  broadcast;		// Otherwise each frame goes to a random peer
+	uint8_t  size;			// Payload bytes
+	uint8_t  nodes;
+	uint16_t drsreg;		// Data rate, 0 keeps the default profile
+	double   load;			// Frames per second per node
+	uint32_t seed;
+	SimTime  poll;			// Between ReceivePacket() calls, 0 uses OnReceive()
+} SimTraffic;
+
+/*******************************************************************************
+ * Coordinator to node.  A run lets the node execute until the given time,
+ * with the received bytes that arrive meanwhile; count SimDelivery follow
+ * the command.  Stop asks for the final counters.
+ ******************************************************************************/
+#define SIM_CMD_RUN     1
+#define SIM_CMD_STOP    2
+
+typedef struct {
+	uint32_t command;
+	uint32_t count;
+	SimTime  start;
+	SimTime  until;
+} SimCommand;
+
+#define SIM_RX_SYNC     1		// The sync word of a stream went by, status is valid
+#define SIM_RX_BYTE     2		// A byte of the stream the receiver locked on to
+
+typedef struct {
+	SimTime  time;
+	uint32_t stream;
+	uint16_t status;		// ATRSSI and the low byte of STSREG for this signal
+	uint8_t  kind;
+	uint8_t  data;
+} SimDelivery;
+
+/*******************************************************************************
+ * Node to coordinator, the answer to every command.  count SimEvent follow.
+ ******************************************************************************/
+#define SIM_EV_TX_ON     1		// time = first bit on the air
+#define SIM_EV_TX_BYTE   2		// time = the byte starts going out, data = byte
+#define SIM_EV_TX_OFF    3
+#define SIM_EV_LISTEN    4		// data = 1 if the sync latch is armed, receiver on
+#define SIM_EV_LOCK      5		// value = stream, data = 1 if the latch took it
+#define SIM_EV_REGISTER  6		// value = register command written
+#define SIM_EV_SENT      7		// value = sequence, data = destination
+#define SIM_EV_RECEIVED  8		// value = sequence, data = source
+#define SIM_EV_ERRORS    9		// value = count, data = MRF_ERROR_*, on stop
+#define SIM_EV_DAMAGED   10		// A frame failed the payload CRC
+#define SIM_EV_TRACE     11		// data = MRF_TRACE_*, value = state, counter, data
+
+typedef struct {
+	SimTime  next;			// When the node has to run again, without deliveries
+	uint32_t count;
+	uint32_t reserved;
+} SimReport;
+
+typedef struct {
+	SimTime  time;
+	uint32_t value;
+	uint8_t  kind;
+	uint8_t  data;
+	uint16_t reserved;
+} SimEvent;
+
+// Node.cpp: the node process, never returns
+void NodeMain(int fd, uint8_t address, const SimTraffic &traffic);
+
+// For the code running on a node
+SimTime NodeNow(void);
+void NodeReport(uint8_t kind, uint8_t data, uint32_t value);
+
+// Traffic.cpp: the sketch every node runs.  TrafficLoop() returns the time
+// it has something to do next, NodeNow() while it's busy.
+void TrafficSetup(uint8_t address, const SimTraffic &traffic);
+SimTime TrafficLoop(void);
+
+#endif
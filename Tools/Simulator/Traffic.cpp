@@ -0,0 +1,181 @@
+/*
+ *  Traffic.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  The sketch every simulated node runs.  It brings the transceiver up the
+ *  way PingPong does, then offers frames at random (Poisson) times, each
+ *  to a random peer or to everyone.  Serial types go through the serial
+ *  bridge (Packet.ByteReceived()) as if typed in; those frames carry no
+ *  address, so they're always broadcasts.
+ *
+ *  Frames are taken with a receive handler, or with --poll by calling
+ *  ReceivePacket() at fixed intervals.  The packet it returns is held
+ *  until the next call, as a sketch that's busy with it would.
+ *
+ */
+
+#include <Arduino.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "Simulator.h"
+#include "Crc.h"
+#include "MRF49XA.h"
+#include "Registers.h"
+#include "Packet.h"
+#include "Modes.h"
+#include "PacketTypes.h"
+
+static SimTraffic traffic;
+static uint8_t address;
+static uint8_t started;
+static uint8_t serial;
+static uint32_t sequence;
+static SimTime nextSend;
+static SimTime nextPoll;
+
+static volatile enum device_mode mode = MODE_SERIAL;
+static volatile MRF_counter_t counter = 0;
+
+// Exponential gap between frames, for the offered load
+static SimTime Interval(void)
+{
+	double uniform = (random(0x7FFFFFFF) + 1.0) / 2147483648.0;
+
+	return (SimTime)(-log(uniform) * 1000000.0 / traffic.load);
+}
+
+static uint16_t PayloadCrc(const uint8_t *payload, uint8_t size)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (uint8_t i = 0; i < size; i++)
+	{
+		if (i == SIM_OFFSET_CRC || i == SIM_OFFSET_CRC + 1) continue;
+		crc = Crc16Update(crc, payload[i]);
+	}
+
+	return crc;
+}
+
+static void Received(MRF_packet_t *received)
+{
+	const uint8_t *payload = received->payload;
+	uint16_t crc = payload[SIM_OFFSET_CRC] | (payload[SIM_OFFSET_CRC + 1] << 8);
+
+	if (received->payloadSize < SIM_HEADER_LEN || crc != PayloadCrc(payload, received->payloadSize))
+	{
+		NodeReport(SIM_EV_DAMAGED, 0, 0);
+		return;
+	}
+
+	uint32_t number = 0;
+	for (uint8_t i = 0; i < 4; i++) number |= (uint32_t)payload[SIM_OFFSET_SEQUENCE + i] << (8 * i);
+
+	NodeReport(SIM_EV_RECEIVED, payload[SIM_OFFSET_SOURCE], number);
+}
+
+static void Send(void)
+{
+	uint8_t payload[MRF_PAYLOAD_LEN];
+	uint8_t destination = MRF_ADDRESS_BROADCAST;
+
+	if (!traffic.broadcast && !serial)
+	{
+		destination = random(traffic.nodes - 1);
+		if (destination >= address) destination++;
+	}
+
+	sequence++;
+
+	payload[SIM_OFFSET_SOURCE] = address;
+	for (uint8_t i = 0; i < 4; i++) payload[SIM_OFFSET_SEQUENCE + i] = sequence >> (8 * i);
+	for (uint8_t i = SIM_HEADER_LEN; i < traffic.size; i++) payload[i] = random(256);
+
+	uint16_t crc = PayloadCrc(payload, traffic.size);
+	payload[SIM_OFFSET_CRC] = crc;
+	payload[SIM_OFFSET_CRC + 1] = crc >> 8;
+
+	NodeReport(SIM_EV_SENT, destination, sequence);
+
+	if (serial)
+	{
+		Packet.ByteReceived(traffic.size, counter, mode);
+		Packet.ByteReceived(traffic.type, counter, mode);
+
+		for (uint8_t i = 0; i < traffic.size; i++) Packet.ByteReceived(payload[i], counter, mode);
+
+		return;
+	}
+
+	MRF_packet_t frame;
+
+	frame.type = traffic.type | traffic.flags;
+	frame.payloadSize = traffic.size;
+	memcpy(frame.payload, payload, traffic.size);
+
+	if (destination != MRF_ADDRESS_BROADCAST)
+	{
+		frame.type |= PACKET_FLAG_ADDRESSED;
+		frame.address = destination;
+	}
+
+	MRF49XA.TransmitPacket(&frame);
+}
+
+void TrafficSetup(uint8_t node, const SimTraffic &settings)
+{
+	traffic = settings;
+	address = node;
+
+	uint8_t kind = traffic.type & PACKET_TYPE_MASK;
+	serial = (kind == PACKET_TYPE_SERIAL || kind == PACKET_TYPE_SERIAL_ECC);
+	mode = (kind == PACKET_TYPE_SERIAL_ECC) ? MODE_SERIAL_ECC : MODE_SERIAL;
+
+	// Blank EEPROM, so the default profile
+	Registers.Begin();
+
+	MRF49XA.SetAddress(address);
+	if (!traffic.poll) MRF49XA.OnReceive(Received);
+
+	nextSend = NodeNow() + Interval();
+	nextPoll = NodeNow() + traffic.poll;
+}
+
+SimTime TrafficLoop(void)
+{
+	if (!started)
+	{
+		if (!MRF49XA.Startup()) return NodeNow();
+
+		if (traffic.drsreg) MRF49XA.SetRegister(traffic.drsreg);
+		started = 1;
+	}
+
+	if (MRF49XA.Dispatch()) return NodeNow();
+
+	if (traffic.poll && NodeNow() >= nextPoll)
+	{
+		MRF_packet_t *received = MRF49XA.ReceivePacket();
+
+		if (received) Received(received);
+		nextPoll += traffic.poll;
+
+		return NodeNow();
+	}
+
+	if (NodeNow() >= nextSend)
+	{
+		Send();
+		nextSend += Interval();
+
+		return NodeNow();
+	}
+
+	if (traffic.poll) return std::min(nextSend, nextPoll);
+
+	return nextSend;
+}
@@ -0,0 +1,146 @@
+/*
+ *  Arduino.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  The part of the Arduino core the library uses, for building it on Linux
+ *  inside the simulator.  Time, the SPI bus and the I/O registers are
+ *  implemented by the node model (Node.cpp); there's no real hardware.
+ *
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t boolean;
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+#define MISO        12
+#define LED_BUILTIN 13
+
+#define PROGMEM
+#define F(string) (string)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define memcpy_P memcpy
+
+// An 8 bit I/O register.  Every write is passed to the node model, which
+// watches chip select, the interrupt mask and the interrupt flag in SREG.
+class SimRegister
+{
+public:
+	SimRegister() : value(0) { }
+
+	operator uint8_t() const { return value; }
+
+	SimRegister &operator=(int v);
+	SimRegister &operator|=(int v) { return *this = value | v; }
+	SimRegister &operator&=(int v) { return *this = value & v; }
+
+	uint8_t value;
+};
+
+extern SimRegister PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+extern SimRegister EICRA, EIMSK, EIFR, SREG;
+// Timer 1 counts virtual time at 16 MHz over the prescaler in TCCR1B
+class SimTimer
+{
+public:
+	SimTimer() : offset(0) { }
+
+	operator uint16_t() const;
+	SimTimer &operator=(int v);
+
+	uint16_t offset;
+};
+
+extern SimRegister TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+extern SimTimer TCNT1;
+
+#define ISC11 3
+#define INT1  1
+#define INTF1 1
+#define CS10  0
+#define CS11  1
+#define TOV1  0
+#define TOIE1 0
+
+#define ISR_BLOCK
+#define ISR(vector, ...) extern "C" void vector(void)
+#define INT1_vect        __vector_2
+#define TIMER1_OVF_vect  __vector_13
+
+void noInterrupts(void);
+void interrupts(void);
+
+#define cli() noInterrupts()
+#define sei() interrupts()
+
+// Arduino's unsigned long is 32 bits, and so is the time
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void pinMode(uint8_t pin, uint8_t mode);
+int analogRead(uint8_t pin);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// Output is discarded, nodes have no console
+class Print
+{
+public:
+	virtual ~Print() { }
+
+	virtual size_t write(uint8_t) { return 1; }
+	size_t write(const uint8_t *buffer, size_t size) { return size; }
+
+	size_t print(const char *) { return 0; }
+	size_t print(char) { return 0; }
+	size_t print(long, int = DEC) { return 0; }
+	size_t print(unsigned long, int = DEC) { return 0; }
+	size_t print(int, int = DEC) { return 0; }
+	size_t print(unsigned int, int = DEC) { return 0; }
+	size_t println(const char *) { return 0; }
+	size_t println(long, int = DEC) { return 0; }
+	size_t println(unsigned long, int = DEC) { return 0; }
+	size_t println(void) { return 0; }
+
+	int availableForWrite(void) { return 64; }
+};
+
+class Stream : public Print
+{
+public:
+	int available(void) { return 0; }
+	int read(void) { return -1; }
+};
+
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long) { }
+	operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
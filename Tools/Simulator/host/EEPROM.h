@@ -0,0 +1,42 @@
+/*
+ *  EEPROM.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Host EEPROM, erased (0xFF) at the start of every node
+ *
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+#define SIM_EEPROM_LEN 1024
+
+struct EEPROMClass
+{
+	uint8_t read(int index) { return data[index]; }
+	void write(int index, uint8_t value) { data[index] = value; }
+	void update(int index, uint8_t value) { data[index] = value; }
+	uint16_t length(void) { return SIM_EEPROM_LEN; }
+
+	template <typename T> T &get(int index, T &t)
+	{
+		memcpy(&t, &data[index], sizeof(T));
+		return t;
+	}
+
+	template <typename T> const T &put(int index, const T &t)
+	{
+		memcpy(&data[index], &t, sizeof(T));
+		return t;
+	}
+
+	uint8_t data[SIM_EEPROM_LEN];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ *  SPI.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ *  Host SPI bus, connected to the transceiver model in Node.cpp
+ *
+ */
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <Arduino.h>
+
+class SPIClass
+{
+public:
+	static void begin(void) { }
+	static uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
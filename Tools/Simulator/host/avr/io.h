@@ -0,0 +1,2 @@
+// Everything is in the host Arduino.h
+#include <Arduino.h>
@@ -0,0 +1,100 @@
+/*
+ *  Trace.cpp
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#include "Trace.h"
+
+#ifdef MRF_TRACE
+
+#include "MRF49XA_definitions.h"
+
+Trace_t Trace = Trace_t();
+
+void Trace_t::Begin(void)
+{
+	head = 0;
+	tail = 0;
+	lost = 0;
+
+	MRF_TIMER_SETUP();
+}
+
+// Called from the ISR, or from code that the ISR may interrupt (Reset()),
+// so the slot is claimed with interrupts held off for a few cycles.
+void Trace_t::Record(uint8_t event, uint8_t state, uint8_t counter, uint8_t data)
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	uint8_t next = (head + 1) & (MRF_TRACE_LEN - 1);
+
+	if (next == tail) 
+	{
+		lost++;
+	}
+	else 
+	{
+		MRF_trace_t *record = &records[head];
+
+		record->time    = MRF_TIMER_READ();
+		record->event   = event;
+		record->state   = state;
+		record->counter = counter;
+		record->data    = data;
+
+		head = next;
+	}
+
+	SREG = sreg;
+}
+
+uint8_t Trace_t::Read(MRF_trace_t *record)
+{
+	uint8_t index = tail;
+
+	if (index == head) return 0;
+
+	*record = records[index];
+
+	// Release the slot only after it's been copied
+	tail = (index + 1) & (MRF_TRACE_LEN - 1);
+
+	return 1;
+}
+
+// One line per record: time, event, state, packetCounter, data
+void Trace_t::Dump(Print &out)
+{
+	MRF_trace_t record;
+
+	while (Read(&record)) 
+	{
+		out.print(record.time, DEC);
+		out.print(' ');
+		out.print(record.event, HEX);
+		out.print(' ');
+		out.print(record.state, HEX);
+		out.print(' ');
+		out.print(record.counter, DEC);
+		out.print(' ');
+		out.print(record.data, HEX);
+		out.print("\n\r");
+	}
+}
+
+uint16_t Trace_t::Lost(void)
+{
+	uint16_t count;
+
+	noInterrupts();
+	count = lost;
+	interrupts();
+
+	return count;
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ *  Trace.h
+ *  MRF49XA
+ *
+ *  Created by David Freitag on 10/19/26.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Uncomment to have the ISR record what the framing state machine does.
+// The library is compiled separately from the sketch, so the switch has to
+// be made here.  When it's off the trace points compile to nothing.
+//#define MRF_TRACE
+
+// Also record every FIFO byte.  This fills the ring within a frame, so it's
+// only useful with a short capture window.
+//#define MRF_TRACE_BYTES
+
+// Number of records kept, must be a power of 2
+#define MRF_TRACE_LEN       32
+
+// Event codes
+#define MRF_TRACE_SYNC          0x01	// Length byte accepted, data = length
+#define MRF_TRACE_BYTE          0x02	// FIFO byte, data = byte
+#define MRF_TRACE_LENGTH_REJECT 0x03	// Bad length byte, data = length
+#define MRF_TRACE_ADDRESS_DROP  0x04	// Frame for another node, data = address
+#define MRF_TRACE_FRAME_DONE    0x05	// Frame handed over, data = type
+#define MRF_TRACE_OVERRUN       0x06	// No buffer for the frame, data = type
+#define MRF_TRACE_REFLECT       0x07	// Test frame echoed, data = type
+#define MRF_TRACE_TX_START      0x08	// data = type
+#define MRF_TRACE_TX_END        0x09	// data = type
+#define MRF_TRACE_RESET         0x0A	// Transceiver reset
+#define MRF_TRACE_SPURIOUS      0x0B	// Interrupt without the FIFO flag
+#define MRF_TRACE_DUPLICATE     0x0C	// Relayed frame seen before, data = source
+#define MRF_TRACE_FORWARD       0x0D	// Relayed frame forwarded, data = hops
+#define MRF_TRACE_AUTH_FAIL     0x0E	// Encrypted frame dropped, data = type
+#define MRF_TRACE_FIFO_OVERFLOW 0x0F	// RX FIFO overflowed in the frame, data = type
+#define MRF_TRACE_UNDERRUN      0x10	// TX register ran empty, data = type
+#define MRF_TRACE_LOST_SYNC     0x11	// Invalid type byte, data = type
+
+typedef struct {
+	uint16_t time;			// MRF_TIMER_READ() ticks
+	uint8_t  event;
+	uint8_t  state;			// mrf_state
+	uint8_t  counter;		// packetCounter
+	uint8_t  data;
+} MRF_trace_t;
+
+#ifdef MRF_TRACE
+
+// Single producer ring.  Only the ISR side writes head and only the drain
+// side writes tail, so neither waits on the other.  When the ring is full
+// new records are dropped and counted, the oldest ones are kept.
+class Trace_t
+{
+public:
+	void Begin(void);
+	void Record(uint8_t event, uint8_t state, uint8_t counter, uint8_t data);
+
+	// Drain side, returns 0 when the ring is empty
+	uint8_t Read(MRF_trace_t *record);
+	void Dump(Print &out);
+	uint16_t Lost(void);
+private:
+	MRF_trace_t records[MRF_TRACE_LEN];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	volatile uint16_t lost;
+};
+
+extern Trace_t Trace;
+
+#define MRF_TRACE_BEGIN()	Trace.Begin()
+#define MRF_TRACE_EVENT(event, data)	Trace.Record(event, mrf_state, packetCounter, data)
+
+#else
+
+#define MRF_TRACE_BEGIN()	((void)0)
+#define MRF_TRACE_EVENT(event, data)	((void)0)
+
+#endif
+
+#if defined(MRF_TRACE) && defined(MRF_TRACE_BYTES)
+#define MRF_TRACE_DATA(data)	MRF_TRACE_EVENT(MRF_TRACE_BYTE, data)
+#else
+#define MRF_TRACE_DATA(data)	((void)0)
+#endif
+
+#endif